@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ngg::bench
+{
+
+/**
+ * @brief Pins the calling thread to a CPU, wrapping around the CPU count.
+ *
+ * @param cpu index of the CPU
+ * @returns false if pinning is unsupported or failed
+ */
+inline bool pin_to_cpu (unsigned cpu)
+{
+#if defined(__linux__)
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpus, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+/**
+ * @brief Low 32 bits of the steady clock in nanoseconds.
+ *
+ * The zero bit is forced so that a stamp is never 0, 0 means unsampled.
+ * Differences of two stamps are exact for delays below ~4 seconds.
+ */
+inline std::uint32_t stamp32 ()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint32_t>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(now)
+                   .count()) |
+           1u;
+}
+
+/**
+ * @brief Message of a fixed size carrying an enqueue stamp.
+ *
+ * @tparam Bytes total size of the message, at least 4
+ */
+template <std::size_t Bytes>
+struct payload
+{
+    static_assert(Bytes >= sizeof(std::uint32_t));
+
+    std::uint32_t stamp = 0;
+    std::byte padding[Bytes - sizeof(std::uint32_t)]{};
+};
+
+template <>
+struct payload<sizeof(std::uint32_t)>
+{
+    std::uint32_t stamp = 0;
+};
+
+/**
+ * @brief Latency samples in nanoseconds with percentile lookup.
+ */
+class latency_samples
+{
+  public:
+    void reserve (std::size_t n)
+    {
+        m_samples.reserve(n);
+    }
+
+    void add (std::uint32_t nanos)
+    {
+        m_samples.push_back(nanos);
+    }
+
+    /**
+     * @brief Returns the nearest-rank sample at quantile q, sorts on first
+     * call.
+     */
+    std::uint32_t percentile (double q)
+    {
+        if (m_samples.empty())
+        {
+            return 0;
+        }
+        if (!m_sorted)
+        {
+            std::sort(m_samples.begin(), m_samples.end());
+            m_sorted = true;
+        }
+        // nikgub: nearest rank, as latency_histogram::percentile
+        const double clamped = q < 0 ? 0 : (q > 1 ? 1 : q);
+        const std::size_t total = m_samples.size();
+        const auto rank = std::clamp<std::size_t>(
+            static_cast<std::size_t>(
+                std::ceil(clamped * static_cast<double>(total))),
+            1, total);
+        return m_samples[rank - 1];
+    }
+
+    std::size_t size () const
+    {
+        return m_samples.size();
+    }
+
+  private:
+    std::vector<std::uint32_t> m_samples;
+    bool m_sorted = false;
+};
+
+} // namespace ngg::bench
@@ -0,0 +1,361 @@
+#include "bounded_mpsc_queue.hpp"
+#include "harness.hpp"
+#include "mpsc_queue.hpp"
+#include "node_slab_allocator.hpp"
+#include "numa_mpsc_queue.hpp"
+#include "parking.hpp"
+#include "segmented_mpsc_queue.hpp"
+#include "sharded_mpsc_queue.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+namespace
+{
+
+struct options
+{
+    unsigned max_producers = std::max(
+        1u, std::min(8u, std::thread::hardware_concurrency() - 1));
+    std::chrono::milliseconds duration{500};
+    std::chrono::milliseconds warmup{100};
+    bool pin = true;
+    std::string variant;  // nikgub: empty means all
+    std::size_t bytes = 0; // nikgub: 0 means all
+};
+
+struct result
+{
+    double mops;
+    std::uint32_t p50;
+    std::uint32_t p99;
+    std::uint32_t p999;
+};
+
+// nikgub: stamping every message would measure the clock, not the queue
+constexpr std::uint64_t sample_every = 64;
+// nikgub: producers back off past this backlog so memory stays bounded
+constexpr std::uint64_t max_backlog = 1 << 16;
+
+// nikgub: baseline for the prefetching consumer of the default policy
+struct no_prefetch : ngg::policy::defaults
+{
+    static constexpr std::size_t prefetch_distance = 0;
+};
+
+/**
+ * @brief Adapter for the node-based queues.
+ */
+template <typename Queue>
+struct unbounded
+{
+    Queue queue;
+
+    template <typename V>
+    bool try_push (const V &value)
+    {
+        queue.push(value);
+        return true;
+    }
+
+    template <typename F>
+    std::size_t drain (F &&func)
+    {
+        return queue.consume_all(func, 256);
+    }
+};
+
+/**
+ * @brief Adapter for node-based queues with a pre-faulted node reserve.
+ */
+template <typename Queue>
+struct reserved
+{
+    Queue queue{max_backlog};
+
+    template <typename V>
+    bool try_push (const V &value)
+    {
+        queue.push(value);
+        return true;
+    }
+
+    template <typename F>
+    std::size_t drain (F &&func)
+    {
+        return queue.consume_all(func, 256);
+    }
+};
+
+/**
+ * @brief Adapter for bounded_mpsc_queue.
+ */
+template <typename Queue>
+struct bounded
+{
+    Queue queue{max_backlog};
+
+    template <typename V>
+    bool try_push (const V &value)
+    {
+        return queue.try_push(value);
+    }
+
+    template <typename F>
+    std::size_t drain (F &&func)
+    {
+        return queue.consume_all(func, 256);
+    }
+};
+
+/**
+ * @brief Adapter for queues with a capacity policy, limit set by the type.
+ */
+template <typename Queue>
+struct capped
+{
+    Queue queue;
+
+    template <typename V>
+    bool try_push (const V &value)
+    {
+        return queue.try_push(value);
+    }
+
+    template <typename F>
+    std::size_t drain (F &&func)
+    {
+        return queue.consume_all(func, 256);
+    }
+};
+
+/**
+ * @brief Runs producers against one consumer on the calling thread.
+ */
+template <typename Adapter, std::size_t Bytes>
+result run (const options &opt, unsigned producers)
+{
+    using message = ngg::bench::payload<Bytes>;
+
+    Adapter target;
+    std::atomic<bool> start{false};
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> consumed{0};
+
+    std::vector<std::jthread> threads;
+    for (unsigned p = 0; p < producers; ++p)
+    {
+        threads.emplace_back(
+            [&, p]
+            {
+                if (opt.pin)
+                {
+                    ngg::bench::pin_to_cpu(p + 1);
+                }
+                while (!start.load(std::memory_order_acquire))
+                {
+                    ngg::detail::cpu_relax();
+                }
+                std::uint64_t pushed = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    message m;
+                    if (pushed % sample_every == 0)
+                    {
+                        m.stamp = ngg::bench::stamp32();
+                    }
+                    while (!target.try_push(m))
+                    {
+                        // nikgub: full, spin unless we are told to leave
+                        if (stop.load(std::memory_order_relaxed))
+                        {
+                            return;
+                        }
+                        ngg::detail::cpu_relax();
+                    }
+                    ++pushed;
+                    if (pushed % 256 == 0)
+                    {
+                        while (pushed * producers >
+                                   consumed.load(std::memory_order_relaxed) +
+                                       max_backlog &&
+                               !stop.load(std::memory_order_relaxed))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                }
+            });
+    }
+
+    ngg::bench::latency_samples samples;
+    samples.reserve(1 << 20);
+    std::uint64_t total   = 0;
+    std::uint64_t counted = 0;
+    bool measuring        = false;
+    auto on_message       = [&] (message &&m)
+    {
+        if (measuring && m.stamp != 0)
+        {
+            samples.add(ngg::bench::stamp32() - m.stamp);
+        }
+    };
+
+    start.store(true, std::memory_order_release);
+    const auto begin    = std::chrono::steady_clock::now();
+    const auto measured = begin + opt.warmup;
+    const auto end      = measured + opt.duration;
+    while (true)
+    {
+        const std::size_t n = target.drain(on_message);
+        total += n;
+        if (measuring)
+        {
+            counted += n;
+        }
+        consumed.store(total, std::memory_order_relaxed);
+        if (n == 0 || total % 1024 < n)
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= end)
+            {
+                break;
+            }
+            measuring = now >= measured;
+        }
+    }
+    stop.store(true, std::memory_order_relaxed);
+    threads.clear();
+    measuring = false;
+    while (target.drain(on_message) != 0)
+    {
+    }
+
+    const double seconds = std::chrono::duration<double>(opt.duration).count();
+    return {static_cast<double>(counted) / seconds / 1e6,
+            samples.percentile(0.5), samples.percentile(0.99),
+            samples.percentile(0.999)};
+}
+
+template <typename Adapter, std::size_t Bytes>
+void sweep (const options &opt, const char *name)
+{
+    if (!opt.variant.empty() && opt.variant != name)
+    {
+        return;
+    }
+    if (opt.bytes != 0 && opt.bytes != Bytes)
+    {
+        return;
+    }
+    for (unsigned producers = 1; producers <= opt.max_producers;
+         producers = producers < opt.max_producers
+                         ? std::min(producers * 2, opt.max_producers)
+                         : producers + 1)
+    {
+        const result r = run<Adapter, Bytes>(opt, producers);
+        std::printf("%-12s %6zu %9u %10.2f %9u %9u %9u\n", name, Bytes,
+                    producers, r.mops, r.p50, r.p99, r.p999);
+        std::fflush(stdout);
+    }
+}
+
+template <std::size_t Bytes>
+void sweep_variants (const options &opt)
+{
+    using message = ngg::bench::payload<Bytes>;
+    sweep<unbounded<ngg::mpsc_queue<message>>, Bytes>(opt, "heap");
+    sweep<unbounded<ngg::mpsc_queue<message, std::allocator<message>,
+                                    no_prefetch>>,
+          Bytes>(opt, "no-prefetch");
+    sweep<unbounded<ngg::mpsc_queue<message, std::allocator<message>,
+                                    ngg::policy::pooled>>,
+          Bytes>(opt, "pooled");
+    sweep<unbounded<ngg::mpsc_queue<message, std::allocator<message>,
+                                    ngg::policy::padded>>,
+          Bytes>(opt, "padded");
+    sweep<unbounded<ngg::mpsc_queue<message,
+                                    ngg::node_slab_allocator<message>>>,
+          Bytes>(opt, "slab");
+    sweep<reserved<ngg::mpsc_queue<message>>, Bytes>(opt, "reserved");
+    sweep<unbounded<ngg::segmented_mpsc_queue<message>>, Bytes>(opt,
+                                                               "segmented");
+    sweep<bounded<ngg::bounded_mpsc_queue<message>>, Bytes>(opt, "bounded");
+    sweep<capped<ngg::mpsc_queue<message, std::allocator<message>,
+                                 ngg::policy::capped<max_backlog>>>,
+          Bytes>(opt, "capped");
+    sweep<unbounded<ngg::sharded_mpsc_queue<message>>, Bytes>(opt, "sharded");
+    sweep<unbounded<ngg::numa_mpsc_queue<message>>, Bytes>(opt, "numa");
+}
+
+options parse (int argc, char **argv)
+{
+    options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        auto value            = [&arg] (const char *prefix) -> const char *
+        {
+            const std::size_t n = std::strlen(prefix);
+            return arg.compare(0, n, prefix) == 0 ? arg.c_str() + n : nullptr;
+        };
+        if (const char *v = value("--producers="))
+        {
+            opt.max_producers = std::max(1, std::atoi(v));
+        }
+        else if (const char *v = value("--duration="))
+        {
+            opt.duration = std::chrono::milliseconds(std::atoi(v));
+        }
+        else if (const char *v = value("--warmup="))
+        {
+            opt.warmup = std::chrono::milliseconds(std::atoi(v));
+        }
+        else if (const char *v = value("--variant="))
+        {
+            opt.variant = v;
+        }
+        else if (const char *v = value("--payload="))
+        {
+            opt.bytes = static_cast<std::size_t>(std::atoll(v));
+        }
+        else if (arg == "--no-pin")
+        {
+            opt.pin = false;
+        }
+        else
+        {
+            std::fprintf(stderr,
+                         "usage: %s [--producers=N] [--duration=ms] "
+                         "[--warmup=ms] [--variant=name] [--payload=bytes] "
+                         "[--no-pin]\n",
+                         argv[0]);
+            std::exit(2);
+        }
+    }
+    return opt;
+}
+
+} // namespace
+
+int main (int argc, char **argv)
+{
+    const options opt = parse(argc, argv);
+    if (opt.pin)
+    {
+        ngg::bench::pin_to_cpu(0);
+    }
+    std::printf("%-12s %6s %9s %10s %9s %9s %9s\n", "variant", "bytes",
+                "producers", "Mops/s", "p50 ns", "p99 ns", "p999 ns");
+    sweep_variants<4>(opt);
+    sweep_variants<64>(opt);
+    sweep_variants<256>(opt);
+    sweep_variants<1024>(opt);
+}
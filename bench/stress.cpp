@@ -0,0 +1,492 @@
+#include "mpmc_queue.hpp"
+#include "mpsc_queue.hpp"
+#include "policy.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+struct options
+{
+    unsigned producers =
+        std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    unsigned rounds         = 20;
+    std::uint64_t per_round = 20000; // nikgub: pushes per producer, at most
+    std::uint64_t seed      = 1;
+};
+
+/**
+ * @brief Element that notices being delivered moved-from or out of order.
+ */
+struct message
+{
+    std::uint32_t producer = 0;
+    std::uint64_t seq      = 0;
+    std::string body; // nikgub: heap-sized on purpose, a moved-from one is ""
+
+    message (std::uint32_t p, std::uint64_t s)
+        : producer(p), seq(s), body(expected_body(p, s))
+    {
+    }
+
+    static std::string expected_body (std::uint32_t p, std::uint64_t s)
+    {
+        return std::string(24 + s % 16, static_cast<char>('a' + p % 26));
+    }
+};
+
+/**
+ * @brief mpsc_queue fed from a pre-faulted node reserve first.
+ *
+ * Small on purpose, so rounds run through the reserve and the heap.
+ */
+struct reserved_queue : ngg::mpsc_queue<message>
+{
+    reserved_queue () : mpsc_queue(1024)
+    {
+    }
+};
+
+template <typename... Args>
+[[noreturn]] void fail (const char *format, Args... args)
+{
+    std::fprintf(stderr, "stress: ");
+    std::fprintf(stderr, format, args...);
+    std::fprintf(stderr, "\n");
+    std::exit(1);
+}
+
+/**
+ * @brief Consumer-side bookkeeping, exits on the first violation.
+ */
+class checker
+{
+  public:
+    explicit checker (unsigned producers) : m_next(producers, 0)
+    {
+    }
+
+    void operator() (message &&m)
+    {
+        if (m.producer >= m_next.size())
+        {
+            fail("unknown producer %u", m.producer);
+        }
+        if (m.seq != m_next[m.producer])
+        {
+            fail("producer %u: got seq %llu, expected %llu", m.producer,
+                 static_cast<unsigned long long>(m.seq),
+                 static_cast<unsigned long long>(m_next[m.producer]));
+        }
+        if (m.body != message::expected_body(m.producer, m.seq))
+        {
+            fail("producer %u seq %llu: corrupted or moved-from body",
+                 m.producer, static_cast<unsigned long long>(m.seq));
+        }
+        ++m_next[m.producer];
+        ++m_consumed;
+    }
+
+    std::uint64_t consumed () const
+    {
+        return m_consumed;
+    }
+
+  private:
+    std::vector<std::uint64_t> m_next;
+    std::uint64_t m_consumed = 0;
+};
+
+/**
+ * @brief Pushes through every entry point until the quota or close().
+ *
+ * @returns amount of accepted elements, their seqs are 0 to the result
+ */
+template <typename Queue>
+std::uint64_t produce (Queue &queue, std::uint32_t self, std::uint64_t quota,
+                       std::uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uint64_t seq = 0;
+    while (seq < quota)
+    {
+        bool accepted       = false;
+        std::uint64_t count = 1;
+        switch (rng() % 5)
+        {
+        case 0:
+        {
+            const message m(self, seq);
+            accepted = queue.push(m);
+            break;
+        }
+        case 1:
+            accepted = queue.push(message(self, seq));
+            break;
+        case 2:
+            accepted = queue.emplace(self, seq);
+            break;
+        case 3:
+            accepted = queue.try_push(message(self, seq));
+            if (!accepted && !queue.is_closed())
+            {
+                continue; // nikgub: full, another entry point may wait
+            }
+            break;
+        default:
+        {
+            count = 1 + rng() % 8;
+            std::vector<message> batch;
+            for (std::uint64_t i = 0; i < count; ++i)
+            {
+                batch.emplace_back(self, seq + i);
+            }
+            accepted = queue.push_bulk(std::move(batch));
+            break;
+        }
+        }
+        if (!accepted)
+        {
+            break; // nikgub: closed, nothing of this attempt was queued
+        }
+        seq += count;
+    }
+    return seq;
+}
+
+/**
+ * @brief One round: producers race a consumer that closes midway.
+ *
+ * The consumer rotates through every pull flavour, closes the queue after
+ * a random amount of elements, keeps waiting until pull_wait reports closed
+ * and empty, joins the producers and drains. Every accepted element must
+ * come out exactly once and in per-producer order.
+ */
+template <typename Queue>
+void round (const options &opt, std::uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+    Queue queue;
+    std::vector<std::uint64_t> accepted(opt.producers, 0);
+    std::vector<std::jthread> threads;
+    for (std::uint32_t p = 0; p < opt.producers; ++p)
+    {
+        threads.emplace_back(
+            [&, p, s = rng()]
+            { accepted[p] = produce(queue, p, opt.per_round, s); });
+    }
+
+    checker check(opt.producers);
+    const std::uint64_t close_after =
+        rng() % (opt.per_round * opt.producers / 2 + 1);
+    while (check.consumed() < close_after)
+    {
+        switch (rng() % 6)
+        {
+        case 0:
+            if (auto v = queue.pull())
+            {
+                check(std::move(*v));
+            }
+            break;
+        case 1:
+            if (auto v = queue.pull_wait())
+            {
+                check(std::move(*v));
+            }
+            break;
+        case 2:
+            queue.consume_all(check, 1 + rng() % 64);
+            break;
+        case 3:
+            if (message *front = queue.front())
+            {
+                check(std::move(*front));
+                queue.pop();
+            }
+            break;
+        case 4:
+        {
+            message m(0, 0);
+            if (queue.try_pull(m))
+            {
+                check(std::move(m));
+            }
+            break;
+        }
+        default:
+            queue.drain(check);
+            break;
+        }
+    }
+    queue.close();
+    while (auto v = queue.pull_wait())
+    {
+        check(std::move(*v));
+    }
+    threads.clear();
+    // nikgub: pushes that raced close() may land after pull_wait gave up
+    queue.drain(check);
+    if (!queue.is_closed() || queue.push(message(0, 0)))
+    {
+        fail("push accepted after close()");
+    }
+
+    std::uint64_t total = 0;
+    for (std::uint64_t n : accepted)
+    {
+        total += n;
+    }
+    if (total != check.consumed())
+    {
+        fail("accepted %llu elements but consumed %llu",
+             static_cast<unsigned long long>(total),
+             static_cast<unsigned long long>(check.consumed()));
+    }
+}
+
+/**
+ * @brief One round of several consumers racing on an mpmc_queue.
+ *
+ * Every consumer must see the elements of a producer in increasing order,
+ * and over all of them every element must come out exactly once.
+ */
+template <typename Queue>
+void mpmc_round (const options &opt, std::uint64_t seed)
+{
+    constexpr unsigned consumers = 3;
+    std::mt19937_64 rng(seed);
+    Queue queue;
+    const std::uint64_t total = opt.per_round * opt.producers;
+    std::unique_ptr<std::atomic<bool>[]> seen(new std::atomic<bool>[total]{});
+    std::atomic<std::uint64_t> consumed{0};
+    std::vector<std::jthread> threads;
+    for (std::uint32_t p = 0; p < opt.producers; ++p)
+    {
+        threads.emplace_back(
+            [&, p, s = rng()]
+            {
+                std::mt19937_64 local(s);
+                std::uint64_t seq = 0;
+                while (seq < opt.per_round)
+                {
+                    if (local() % 4 != 0)
+                    {
+                        queue.emplace(p, seq++);
+                        continue;
+                    }
+                    std::vector<message> batch;
+                    const std::uint64_t end =
+                        std::min(opt.per_round, seq + 1 + local() % 8);
+                    for (; seq < end; ++seq)
+                    {
+                        batch.emplace_back(p, seq);
+                    }
+                    queue.push_bulk(std::move(batch));
+                }
+            });
+    }
+    for (unsigned c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back(
+            [&, s = rng()]
+            {
+                std::mt19937_64 local(s);
+                // nikgub: seq + 1 of the newest element seen per producer
+                std::vector<std::uint64_t> after(opt.producers, 0);
+                auto check = [&] (message &&m)
+                {
+                    const auto seq = static_cast<unsigned long long>(m.seq);
+                    if (m.producer >= opt.producers || m.seq >= opt.per_round ||
+                        m.seq < after[m.producer])
+                    {
+                        fail("mpmc: producer %u seq %llu out of order",
+                             m.producer, seq);
+                    }
+                    if (m.body != message::expected_body(m.producer, m.seq))
+                    {
+                        fail("mpmc: producer %u seq %llu corrupted", m.producer,
+                             seq);
+                    }
+                    after[m.producer] = m.seq + 1;
+                    const std::uint64_t slot = m.producer * opt.per_round + seq;
+                    if (seen[slot].exchange(true))
+                    {
+                        fail("mpmc: producer %u seq %llu delivered twice",
+                             m.producer, seq);
+                    }
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                };
+                while (consumed.load(std::memory_order_relaxed) < total)
+                {
+                    if (local() % 2 == 0)
+                    {
+                        if (auto v = queue.pull())
+                        {
+                            check(std::move(*v));
+                        }
+                    }
+                    else
+                    {
+                        queue.consume_all(check, 1 + local() % 64);
+                    }
+                }
+            });
+    }
+    threads.clear();
+    for (std::uint64_t i = 0; i < total; ++i)
+    {
+        if (!seen[i].load(std::memory_order_relaxed))
+        {
+            fail("mpmc: producer %llu seq %llu lost",
+                 static_cast<unsigned long long>(i / opt.per_round),
+                 static_cast<unsigned long long>(i % opt.per_round));
+        }
+    }
+}
+
+/**
+ * @brief One round of sparse pushes against a consumer that parks.
+ *
+ * Producers sleep between pushes so the consumer keeps going through the
+ * spin, park and wake handshake of link_chain and wait_impl. A pull that
+ * times out while elements are still due means a lost wake-up.
+ */
+template <typename Queue>
+void wakeup_round (const options &opt, std::uint64_t seed)
+{
+    constexpr std::uint64_t pushes = 200;
+    std::mt19937_64 rng(seed);
+    Queue queue;
+    std::vector<std::jthread> threads;
+    for (std::uint32_t p = 0; p < opt.producers; ++p)
+    {
+        threads.emplace_back(
+            [&, p, s = rng()]
+            {
+                std::mt19937_64 local(s);
+                for (std::uint64_t seq = 0; seq < pushes; ++seq)
+                {
+                    std::this_thread::sleep_for(
+                        std::chrono::microseconds(local() % 64));
+                    queue.emplace(p, seq);
+                }
+            });
+    }
+    checker check(opt.producers);
+    while (check.consumed() < pushes * opt.producers)
+    {
+        auto v = queue.pull_wait_for(std::chrono::seconds(5));
+        if (!v)
+        {
+            fail("wake-up lost after %llu elements",
+                 static_cast<unsigned long long>(check.consumed()));
+        }
+        check(std::move(*v));
+    }
+}
+
+template <typename Queue>
+void run (const options &opt, const char *name)
+{
+    for (unsigned r = 0; r < opt.rounds; ++r)
+    {
+        round<Queue>(opt, opt.seed * 1000003 + r);
+    }
+    std::printf("%-12s %u rounds ok\n", name, opt.rounds);
+    std::fflush(stdout);
+}
+
+template <typename Queue>
+void run_mpmc (const options &opt, const char *name)
+{
+    for (unsigned r = 0; r < opt.rounds; ++r)
+    {
+        mpmc_round<Queue>(opt, opt.seed * 1000003 + r);
+    }
+    std::printf("%-12s %u rounds ok\n", name, opt.rounds);
+    std::fflush(stdout);
+}
+
+template <typename Queue>
+void run_wakeup (const options &opt, const char *name)
+{
+    // nikgub: sleeps dominate, a few rounds are plenty
+    const unsigned rounds = std::max(1u, opt.rounds / 4);
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        wakeup_round<Queue>(opt, opt.seed * 1000003 + r);
+    }
+    std::printf("%-12s %u rounds ok\n", name, rounds);
+    std::fflush(stdout);
+}
+
+options parse (int argc, char **argv)
+{
+    options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        auto value            = [&arg] (const char *prefix) -> const char *
+        {
+            const std::size_t n = std::strlen(prefix);
+            return arg.compare(0, n, prefix) == 0 ? arg.c_str() + n : nullptr;
+        };
+        if (const char *v = value("--producers="))
+        {
+            opt.producers = std::max(1, std::atoi(v));
+        }
+        else if (const char *v = value("--rounds="))
+        {
+            opt.rounds = std::max(1, std::atoi(v));
+        }
+        else if (const char *v = value("--elements="))
+        {
+            opt.per_round = std::max(1ll, std::atoll(v));
+        }
+        else if (const char *v = value("--seed="))
+        {
+            opt.seed = std::strtoull(v, nullptr, 10);
+        }
+        else
+        {
+            std::fprintf(stderr,
+                         "usage: %s [--producers=N] [--rounds=N] "
+                         "[--elements=N] [--seed=N]\n",
+                         argv[0]);
+            std::exit(2);
+        }
+    }
+    return opt;
+}
+
+} // namespace
+
+int main (int argc, char **argv)
+{
+    const options opt = parse(argc, argv);
+    run<ngg::mpsc_queue<message>>(opt, "heap");
+    run<ngg::mpsc_queue<message, std::allocator<message>,
+                        ngg::policy::pooled>>(opt, "pooled");
+    run<ngg::mpsc_queue<message, std::allocator<message>,
+                        ngg::policy::instrumented>>(opt, "instrumented");
+    run<reserved_queue>(opt, "reserved");
+    run<ngg::mpsc_queue<message, std::allocator<message>,
+                        ngg::policy::capped<256>>>(opt, "capped");
+    run<ngg::mpsc_queue<message, std::allocator<message>,
+                        ngg::policy::traced>>(opt, "traced");
+    run_mpmc<ngg::mpmc_queue<message>>(opt, "mpmc-hazard");
+    run_mpmc<ngg::mpmc_queue<message, std::allocator<message>,
+                             ngg::policy::epoch_reclaimed>>(opt, "mpmc-epoch");
+    run_wakeup<ngg::mpsc_queue<message>>(opt, "wakeup");
+}
@@ -0,0 +1,107 @@
+#include "mpsc_queue.hpp"
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// nikgub: the smallest task that runs eagerly and cleans up after itself
+struct detached
+{
+    struct promise_type
+    {
+        detached get_return_object ()
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend () noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend () noexcept
+        {
+            return {};
+        }
+
+        void return_void ()
+        {
+        }
+
+        void unhandled_exception ()
+        {
+            std::terminate();
+        }
+    };
+};
+
+// nikgub: single-threaded executor, itself fed by an mpsc_queue
+struct executor
+{
+    ngg::mpsc_queue<std::coroutine_handle<>> ready;
+
+    void operator() (std::coroutine_handle<> handle)
+    {
+        ready.push(handle);
+    }
+};
+
+detached consume (ngg::mpsc_queue<int> &queue, executor &on,
+                  std::atomic<long long> &sum, long long expected)
+{
+    for (long long count = 0; count < expected; ++count)
+    {
+        auto v = co_await queue.next(std::ref(on));
+        sum.fetch_add(*v, std::memory_order_relaxed);
+    }
+    sum.fetch_add(-1, std::memory_order_release); // nikgub: done marker
+}
+
+} // namespace
+
+int main (void)
+{
+    constexpr int producers = 4;
+    constexpr int per_producer = 100000;
+
+    ngg::mpsc_queue<int> queue;
+    executor on;
+    std::atomic<long long> sum{0};
+    consume(queue, on, sum, producers * per_producer);
+
+    {
+        std::vector<std::jthread> threads;
+        for (int p = 0; p < producers; ++p)
+        {
+            threads.emplace_back(
+                [&queue]
+                {
+                    for (int i = 0; i < per_producer; ++i)
+                    {
+                        queue.push(1);
+                    }
+                });
+        }
+        // nikgub: run resumed coroutines until the consumer finishes
+        while (sum.load(std::memory_order_acquire) !=
+               producers * per_producer - 1)
+        {
+            if (auto handle = on.ready.pull_wait_for(
+                    std::chrono::milliseconds(10)))
+            {
+                handle->resume();
+            }
+        }
+    }
+    while (auto handle = on.ready.pull())
+    {
+        handle->resume();
+    }
+    std::cout << "consumed " << sum.load() + 1 << '\n';
+}
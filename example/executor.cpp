@@ -0,0 +1,31 @@
+#include "serial_executor.hpp"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main (void)
+{
+    ngg::serial_executor<> executor;
+    long long sum = 0; // nikgub: only ever touched by tasks, no lock needed
+    std::jthread runner([&executor] { executor.run(); });
+
+    std::vector<std::jthread> producers;
+    for (int p = 0; p < 4; ++p)
+    {
+        producers.emplace_back(
+            [&executor, &sum, p]
+            {
+                for (int i = 0; i < 100000; ++i)
+                {
+                    executor.submit([&sum, i] { sum += i; });
+                }
+                std::string name = "producer " + std::to_string(p);
+                executor.submit([name = std::move(name)]
+                                { std::cout << name << " done\n"; });
+            });
+    }
+    producers.clear();
+    executor.submit([&sum] { std::cout << "sum: " << sum << '\n'; });
+    executor.close();
+}
@@ -0,0 +1,59 @@
+#include "shm_mpsc_queue.hpp"
+#include <iostream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct sample
+{
+    int producer;
+    int value;
+};
+
+int main (void)
+{
+    using queue_type = ngg::shm_mpsc_queue<sample>;
+    const char *name = "/ngg-shm-example";
+    ngg::shm_segment::unlink(name); // nikgub: leftover of a crashed run
+    auto segment =
+        ngg::shm_segment::create(name, queue_type::required_bytes(4096));
+    queue_type queue = queue_type::create(segment.data(), segment.size());
+
+    constexpr int producers    = 3;
+    constexpr int per_producer = 100000;
+    std::vector<pid_t> children;
+    for (int p = 0; p < producers; ++p)
+    {
+        if (const pid_t pid = ::fork(); pid != 0)
+        {
+            children.push_back(pid);
+            continue;
+        }
+        // nikgub: a sidecar would be a separate program doing the same
+        auto mapping = ngg::shm_segment::open(name);
+        auto view    = queue_type::attach(mapping.data(), mapping.size());
+        for (int i = 0; i < per_producer; ++i)
+        {
+            while (!view.try_push(sample{p, i}))
+            {
+                std::this_thread::yield();
+            }
+        }
+        ::_exit(0);
+    }
+
+    long long sum = 0;
+    int received  = 0;
+    while (received < producers * per_producer)
+    {
+        received += static_cast<int>(
+            queue.consume_all([&sum] (sample &&s) { sum += s.value; }));
+    }
+    for (const pid_t pid : children)
+    {
+        ::waitpid(pid, nullptr, 0);
+    }
+    ngg::shm_segment::unlink(name);
+    std::cout << "received " << received << ", sum " << sum << '\n';
+}
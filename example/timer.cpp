@@ -32,14 +32,12 @@ int main (void)
     auto lambda_consumer = [&queue] (std::stop_token token)
     {
         long long count = 0;
-        while (!token.stop_requested())
+        while (auto v = queue.pull_wait(token))
         {
-            if (auto v = queue.pull())
-            {
-                ++count;
-            }
+            ++count;
         }
-        while (auto v = queue.pull())
+        int value;
+        while (queue.try_pull(value))
         {
             ++count;
         }
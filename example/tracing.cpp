@@ -0,0 +1,53 @@
+#include "mpsc_queue.hpp"
+#include "policy.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std::literals::chrono_literals;
+
+int main (void)
+{
+    ngg::mpsc_queue<int, std::allocator<int>, ngg::policy::traced> queue;
+    std::jthread consumer(
+        [&queue] (std::stop_token token)
+        {
+            while (queue.pull_wait(token))
+            {
+            }
+        });
+
+    std::vector<std::jthread> producers;
+    for (int p = 0; p < 4; ++p)
+    {
+        producers.emplace_back(
+            [&queue]
+            {
+                for (int i = 0; i < 100000; ++i)
+                {
+                    queue.push(i);
+                    if (i % 64 == 0)
+                    {
+                        std::this_thread::sleep_for(100us);
+                    }
+                }
+            });
+    }
+    producers.clear();
+    std::this_thread::sleep_for(100ms);
+
+    // nikgub: taken while the consumer still runs, nothing is stopped
+    const auto latency  = queue.latency();
+    const double per_ns = ngg::detail::ticks_per_nanosecond();
+    auto ns             = [per_ns] (std::uint64_t ticks)
+    { return static_cast<std::uint64_t>(static_cast<double>(ticks) / per_ns); };
+    std::cout << "sampled: " << latency.count() << '\n';
+    for (const double q : {0.5, 0.9, 0.99, 0.999})
+    {
+        std::cout << "p" << q * 100 << ": " << ns(latency.percentile(q))
+                  << " ns\n";
+    }
+    latency.for_each(
+        [&ns] (std::uint64_t low, std::uint64_t high, std::uint64_t n)
+        { std::cout << ns(low) << '-' << ns(high) << " ns: " << n << '\n'; });
+}
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "policy.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ngg
+{
+
+/**
+ * @brief bounded multiple producers/single consumer queue
+ *
+ * Implements Vyukov's bounded queue over a power-of-two ring of slots.
+ * Every slot carries a sequence number telling whose turn it is, producers
+ * claim positions with a CAS on the enqueue index and the single consumer
+ * walks the ring linearly. Memory is allocated once, in the constructor.
+ *
+ * @tparam T type of inner data
+ * @tparam Allocator allocator type, used for the slot ring
+ * @tparam Policy policy bundle, see policy::defaults
+ */
+template <types::queue_element T,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::defaults>
+class bounded_mpsc_queue
+{
+  protected:
+    struct slot;
+    using value_type       = T;
+    using allocator_traits = typename std::allocator_traits<Allocator>;
+    using slot_allocator   = allocator_traits::template rebind_alloc<slot>;
+    using slot_allocator_traits =
+        typename std::allocator_traits<slot_allocator>;
+
+  public:
+    /**
+     * @brief Constructs the queue.
+     *
+     * Allocates the whole ring up front.
+     *
+     * @param capacity minimal amount of elements the queue can hold, rounded
+     * up to a power of two and to at least 2
+     * @param alloc allocator instance
+     */
+    explicit bounded_mpsc_queue (std::size_t capacity,
+                                 const Allocator &alloc = Allocator())
+        : m_capacity(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+          m_mask(m_capacity - 1), m_slot_alloc(alloc)
+    {
+        m_slots = slot_allocator_traits::allocate(m_slot_alloc, m_capacity);
+        for (std::size_t i = 0; i < m_capacity; ++i)
+        {
+            slot_allocator_traits::construct(m_slot_alloc, m_slots + i, i);
+        }
+        // nikgub: relaxed memory since we do not contest anything yet
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    bounded_mpsc_queue (const bounded_mpsc_queue &)            = delete;
+    bounded_mpsc_queue &operator= (const bounded_mpsc_queue &) = delete;
+
+    /**
+     * @brief Destroys the queue and every element left in it.
+     */
+    ~bounded_mpsc_queue ()
+    {
+        clear();
+        for (std::size_t i = 0; i < m_capacity; ++i)
+        {
+            slot_allocator_traits::destroy(m_slot_alloc, m_slots + i);
+        }
+        slot_allocator_traits::deallocate(m_slot_alloc, m_slots, m_capacity);
+    }
+
+    /**
+     * @brief Copies a value into the queue if there is room.
+     *
+     * @param value value being copied
+     * @returns false if the queue is full or closed
+     */
+    bool try_push (const T &value)
+    {
+        return try_emplace(value);
+    }
+
+    /**
+     * @brief Moves a value into the queue if there is room.
+     *
+     * @param value value being forwarded
+     * @returns false if the queue is full or closed, value is untouched
+     * then
+     */
+    bool try_push (T &&value)
+    {
+        return try_emplace(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place if there is room.
+     *
+     * If the constructor may throw, the value is built before a slot is
+     * claimed so that a throwing constructor never leaves a hole.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is full or closed
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool try_emplace (Args &&...args)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        if constexpr (std::is_nothrow_constructible_v<T, Args...>)
+        {
+            slot *target = claim();
+            if (target == nullptr)
+            {
+                return false;
+            }
+            std::construct_at(std::addressof(target->data),
+                              std::forward<Args>(args)...);
+            publish(target);
+        }
+        else
+        {
+            static_assert(std::is_nothrow_move_constructible_v<T>,
+                          "throwing constructors need a nothrow move");
+            T value(std::forward<Args>(args)...);
+            slot *target = claim();
+            if (target == nullptr)
+            {
+                return false;
+            }
+            std::construct_at(std::addressof(target->data), std::move(value));
+            publish(target);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Pops the first element from the queue.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        slot &current = m_slots[m_dequeue_pos & m_mask];
+        // nikgub: acquire the element
+        if (current.sequence.load(std::memory_order_acquire) !=
+            m_dequeue_pos + 1)
+        {
+            return std::nullopt;
+        }
+        std::optional<T> result(std::move(current.data));
+        retire(current);
+        return result;
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable.
+     *
+     * The callable receives an rvalue reference to the element inside its
+     * slot. Slots are visited in order, so the walk is linear in memory.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            slot &current = m_slots[m_dequeue_pos & m_mask];
+            if (current.sequence.load(std::memory_order_acquire) !=
+                m_dequeue_pos + 1)
+            {
+                break;
+            }
+            try
+            {
+                func(std::move(current.data));
+            }
+            catch (...)
+            {
+                retire(current);
+                throw;
+            }
+            retire(current);
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Clears all the elements in the queue.
+     *
+     * Consumer only.
+     */
+    void clear ()
+    {
+        consume_all([] (T &&) {});
+    }
+
+    /**
+     * @brief Rejects all pushes from now on.
+     *
+     * Pushes that started before may still land, elements already queued
+     * stay and can be pulled. Safe from any thread, closing twice is fine.
+     */
+    void close () noexcept
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Returns the amount of slots in the ring.
+     */
+    std::size_t capacity () const noexcept
+    {
+        return m_capacity;
+    }
+
+  protected:
+    /**
+     * @brief Ring slot.
+     *
+     * sequence == position means free for the producer of that position,
+     * sequence == position + 1 means filled for the consumer.
+     */
+    struct alignas(Policy::field_alignment) slot
+    {
+        explicit slot (std::size_t sequence) : sequence(sequence)
+        {
+        }
+
+        // nikgub: data is not ours to destroy
+        ~slot ()
+        {
+        }
+
+        std::atomic<std::size_t> sequence;
+        union
+        {
+            T data;
+        };
+    };
+
+  private:
+    static constexpr std::size_t field_alignment = Policy::field_alignment;
+
+    alignas(field_alignment) std::atomic<std::size_t> m_enqueue_pos;
+    std::atomic<bool> m_closed{false}; // nikgub: producers read it anyway
+    alignas(field_alignment) std::size_t m_dequeue_pos = 0; // nikgub: consumer
+    // nikgub: read-only after construction, shared by everyone
+    alignas(field_alignment) const std::size_t m_capacity;
+    const std::size_t m_mask;
+    slot *m_slots = nullptr;
+    slot_allocator m_slot_alloc;
+
+  private:
+    /**
+     * @brief Claims the slot of the next enqueue position.
+     *
+     * @returns the claimed slot, nullptr if the queue is full
+     */
+    slot *claim ()
+    {
+        std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            slot &target = m_slots[pos & m_mask];
+            const std::size_t sequence =
+                target.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(sequence) -
+                              static_cast<std::intptr_t>(pos);
+            if (diff == 0)
+            {
+                // nikgub: contested, but only among producers
+                if (m_enqueue_pos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                {
+                    return &target;
+                }
+            }
+            else if (diff < 0)
+            {
+                // nikgub: the consumer has not freed this lap yet
+                return nullptr;
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Hands a filled slot over to the consumer.
+     */
+    static void publish (slot *target)
+    {
+        const std::size_t pos =
+            target->sequence.load(std::memory_order_relaxed);
+        target->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Destroys the value of the current slot and frees it for the
+     * next lap.
+     */
+    void retire (slot &current)
+    {
+        std::destroy_at(std::addressof(current.data));
+        current.sequence.store(m_dequeue_pos + m_capacity,
+                               std::memory_order_release);
+        ++m_dequeue_pos;
+    }
+};
+
+} // namespace ngg
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+namespace ngg
+{
+
+/**
+ * @brief Destructive interference size of the target.
+ *
+ * Takes the value of std::hardware_destructive_interference_size when the
+ * standard library provides it, 64 otherwise. Keep in mind that the value
+ * is baked into the layout of every queue, so all translation units that
+ * share a queue type must agree on it.
+ */
+#if defined(__cpp_lib_hardware_interference_size)
+// nikgub: gcc warns about the ABI hazard described above, we know
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+inline constexpr std::size_t cache_line_size =
+    std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+inline constexpr std::size_t cache_line_size = 64;
+#endif
+
+namespace detail
+{
+
+/**
+ * @brief Hints the CPU to pull the lines of [p, p + Bytes) into cache.
+ *
+ * At most MaxLines lines are touched, the hint is dropped on compilers
+ * without __builtin_prefetch.
+ *
+ * @tparam Bytes size of the object behind p
+ * @tparam MaxLines cap on the amount of lines hinted
+ * @param p start of the object
+ */
+template <std::size_t Bytes, std::size_t MaxLines = 8>
+inline void prefetch (const void *p) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    constexpr std::size_t lines = (Bytes + cache_line_size - 1) /
+                                  cache_line_size;
+    const auto *bytes = static_cast<const char *>(p);
+    for (std::size_t i = 0; i < lines && i < MaxLines; ++i)
+    {
+        __builtin_prefetch(bytes + i * cache_line_size, 0, 3);
+    }
+#else
+    (void)p;
+#endif
+}
+
+} // namespace detail
+
+} // namespace ngg
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "parking.hpp"
+#include "thread_registry.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace ngg::policy
+{
+
+/**
+ * @brief Wait strategy that spins with a pause hint.
+ */
+struct spin_wait
+{
+    static constexpr bool parks = false;
+
+    static void pause (std::uint32_t) noexcept
+    {
+        detail::cpu_relax();
+    }
+};
+
+/**
+ * @brief Wait strategy that yields the CPU between attempts.
+ */
+struct yield_wait
+{
+    static constexpr bool parks = false;
+
+    static void pause (std::uint32_t) noexcept
+    {
+        std::this_thread::yield();
+    }
+};
+
+/**
+ * @brief Wait strategy that spins for a while, then sleeps on a futex.
+ *
+ * The consumer wakes sleepers once it has freed a batch of room or runs
+ * empty, so a blocked producer costs the consumer one load per pull.
+ */
+struct park_wait
+{
+    static constexpr bool parks = true;
+
+    static constexpr std::uint32_t spin_rounds = 64;
+
+    static void pause (std::uint32_t) noexcept
+    {
+        detail::cpu_relax();
+    }
+};
+
+/**
+ * @brief Capacity policy without a limit, the original behaviour.
+ */
+struct unbounded
+{
+    static constexpr bool enabled = false;
+
+    class gate
+    {
+      public:
+        bool try_admit (std::size_t) noexcept
+        {
+            return true;
+        }
+
+        template <typename Stop>
+        bool admit (std::size_t, Stop &&) noexcept
+        {
+            return true;
+        }
+
+        void cancel (std::size_t) noexcept
+        {
+        }
+
+        void on_pull (std::size_t) noexcept
+        {
+        }
+
+        void on_idle () noexcept
+        {
+        }
+
+        void wake_all () noexcept
+        {
+        }
+    };
+};
+
+/**
+ * @brief Capacity policy that rejects or blocks producers past a limit.
+ *
+ * Admission is decided on an estimated depth, producers' single-writer
+ * enqueue counters minus the consumer's dequeue counter, and a producer
+ * only looks at it once per grant. A grant is up to Batch pushes, fewer
+ * when the queue is close to the limit, so pushes inside a grant touch
+ * nothing but the producer's own slot. The limit is soft: every producer
+ * may overshoot it by the rest of its grant, at most Batch elements for
+ * single pushes. A bulk push is admitted whole whenever the depth is
+ * below the limit, so it may overshoot by up to its own size.
+ *
+ * @tparam Limit depth past which producers are turned away
+ * @tparam Batch pushes granted per look at the depth
+ * @tparam Wait what a blocking push does while the queue is full
+ */
+template <std::size_t Limit, std::size_t Batch = 64,
+          typename Wait = park_wait>
+    requires(Limit > 0 && Batch > 0)
+struct soft_capacity
+{
+    static constexpr bool enabled      = true;
+    static constexpr std::size_t limit = Limit;
+
+    class gate
+    {
+        struct producer
+        {
+            std::atomic<std::uint64_t> enqueued{0};
+            std::uint64_t grant = 0; // nikgub: owner only
+        };
+
+      public:
+        /**
+         * @brief Admits n elements of the calling producer, never blocks.
+         *
+         * The n elements are admitted together or not at all, a new grant
+         * is at least n large.
+         *
+         * @returns false if the queue is full
+         */
+        bool try_admit (std::size_t n)
+        {
+            producer &self = m_producers.local();
+            if (self.grant < n)
+            {
+                const std::uint64_t d = depth();
+                if (d >= Limit)
+                {
+                    return false;
+                }
+                self.grant = std::max<std::uint64_t>(
+                    n, std::min<std::uint64_t>(Batch, Limit - d));
+            }
+            self.grant -= n;
+            bump(self.enqueued, n);
+            return true;
+        }
+
+        /**
+         * @brief Admits n elements, waiting as Wait says while full.
+         *
+         * @param stopped predicate that ends the wait, e.g. closed
+         * @returns false if stopped before being admitted
+         */
+        template <typename Stop>
+        bool admit (std::size_t n, Stop &&stopped)
+        {
+            for (std::uint32_t round = 0;; ++round)
+            {
+                if (try_admit(n))
+                {
+                    return true;
+                }
+                if (stopped())
+                {
+                    return false;
+                }
+                if constexpr (Wait::parks)
+                {
+                    if (round >= Wait::spin_rounds)
+                    {
+                        sleep(stopped);
+                        continue;
+                    }
+                }
+                Wait::pause(round);
+            }
+        }
+
+        /**
+         * @brief Takes back an admission that was not pushed after all.
+         */
+        void cancel (std::size_t n) noexcept
+        {
+            producer &self = m_producers.local();
+            const std::uint64_t in =
+                self.enqueued.load(std::memory_order_relaxed);
+            self.enqueued.store(in - n, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Consumer hook, n elements left the queue.
+         */
+        void on_pull (std::size_t n) noexcept
+        {
+            // nikgub: seq_cst pairs with the sleeper count in sleep()
+            m_dequeued.store(m_dequeued.load(std::memory_order_relaxed) + n,
+                             std::memory_order_seq_cst);
+            if constexpr (Wait::parks)
+            {
+                const std::uint64_t out =
+                    m_dequeued.load(std::memory_order_relaxed);
+                if (m_sleepers.load(std::memory_order_seq_cst) != 0 &&
+                    out - m_woken_at >= wake_batch)
+                {
+                    m_woken_at = out;
+                    wake_all();
+                }
+            }
+        }
+
+        /**
+         * @brief Consumer hook, the queue looked empty.
+         */
+        void on_idle () noexcept
+        {
+            if constexpr (Wait::parks)
+            {
+                if (m_sleepers.load(std::memory_order_seq_cst) != 0)
+                {
+                    m_woken_at = m_dequeued.load(std::memory_order_relaxed);
+                    wake_all();
+                }
+            }
+        }
+
+        /**
+         * @brief Wakes every sleeping producer, any thread.
+         */
+        void wake_all () noexcept
+        {
+            m_progress.fetch_add(1, std::memory_order_seq_cst);
+            detail::unpark_all(m_progress);
+        }
+
+        /**
+         * @brief Estimated amount of queued elements, safe from any thread.
+         */
+        std::uint64_t depth () const noexcept
+        {
+            const std::uint64_t out =
+                m_dequeued.load(std::memory_order_seq_cst);
+            std::uint64_t in = 0;
+            for (const producer &p : m_producers)
+            {
+                in += p.enqueued.load(std::memory_order_relaxed);
+            }
+            return in > out ? in - out : 0;
+        }
+
+      private:
+        static constexpr std::uint64_t wake_batch = std::min(Batch, Limit);
+
+        static void bump (std::atomic<std::uint64_t> &counter,
+                          std::size_t n) noexcept
+        {
+            // nikgub: single writer, no RMW needed
+            counter.store(counter.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        }
+
+        template <typename Stop>
+        void sleep (Stop &stopped)
+        {
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+            const std::uint32_t seen =
+                m_progress.load(std::memory_order_seq_cst);
+            // nikgub: re-checked after announcing, see on_pull and wake_all
+            if (!stopped() && depth() >= Limit)
+            {
+                detail::park(m_progress, seen);
+            }
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        thread_registry<producer> m_producers;
+        alignas(cache_line_size) std::atomic<std::uint64_t> m_dequeued{0};
+        std::uint64_t m_woken_at = 0; // nikgub: consumer only
+        alignas(cache_line_size) std::atomic<std::uint32_t> m_sleepers{0};
+        std::atomic<std::uint32_t> m_progress{0};
+    };
+};
+
+} // namespace ngg::policy
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace ngg::detail
+{
+
+/**
+ * @brief Cheap monotonic tick counter.
+ *
+ * The TSC on x86, the virtual counter on aarch64, the steady clock in
+ * nanoseconds elsewhere. Ticks are comparable across cores only as far as
+ * the hardware keeps the counters in sync, which is the case on anything
+ * with an invariant TSC.
+ */
+inline std::uint64_t ticks () noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    std::uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+#endif
+}
+
+/**
+ * @brief Rate of ticks() against the steady clock, measured once.
+ *
+ * The first call spins for about a millisecond to calibrate, later calls
+ * return the cached rate. Meant for turning tick deltas into nanoseconds
+ * when reporting, not for the hot path.
+ */
+inline double ticks_per_nanosecond ()
+{
+    static const double rate = []
+    {
+        using clock              = std::chrono::steady_clock;
+        const auto begin         = clock::now();
+        const std::uint64_t from = ticks();
+        auto end                 = begin;
+        while (end - begin < std::chrono::milliseconds(1))
+        {
+            end = clock::now();
+        }
+        const std::uint64_t to = ticks();
+        const auto elapsed =
+            std::chrono::duration<double, std::nano>(end - begin).count();
+        return static_cast<double>(to - from) / elapsed;
+    }();
+    return rate;
+}
+
+} // namespace ngg::detail
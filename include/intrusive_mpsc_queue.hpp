@@ -0,0 +1,232 @@
+#pragma once
+
+#include "policy.hpp"
+#include "types.hpp"
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace ngg
+{
+
+/**
+ * @brief Link embedded in objects queued by intrusive_mpsc_queue.
+ *
+ * An object can be in one queue per hook it embeds, and in that queue at
+ * most once at a time.
+ */
+struct mpsc_hook
+{
+    std::atomic<mpsc_hook *> next{nullptr};
+};
+
+/**
+ * @brief multiple producers/single consumer queue of user-owned objects
+ *
+ * Implements Vyukov's intrusive MPSC queue. Objects are linked through the
+ * mpsc_hook member named by Hook, so push and pull never allocate, copy or
+ * move anything. The queue owns a stub hook that stands in for the
+ * sentinel whenever the queue runs empty, T is never constructed by the
+ * queue.
+ *
+ * The queue does not own the objects: they must stay alive and in place
+ * from push until they are pulled, and whatever is still linked when the
+ * queue is destroyed is simply forgotten.
+ *
+ * @tparam T type of the queued objects
+ * @tparam Hook pointer to the mpsc_hook member of T
+ * @tparam Policy policy bundle, only field_alignment is used
+ */
+template <typename T, mpsc_hook T::*Hook,
+          types::queue_policy Policy = policy::defaults>
+class intrusive_mpsc_queue
+{
+  public:
+    /**
+     * @brief Constructs an empty queue, head and tail point at the stub.
+     */
+    intrusive_mpsc_queue ()
+    {
+        m_head.store(&m_stub, std::memory_order_relaxed);
+        m_tail = &m_stub;
+    }
+
+    intrusive_mpsc_queue (const intrusive_mpsc_queue &)            = delete;
+    intrusive_mpsc_queue &operator= (const intrusive_mpsc_queue &) = delete;
+
+    /**
+     * @brief Links an object in, wait-free.
+     *
+     * @param object object to queue, must not be queued already
+     * @returns false if the queue is closed, object is not linked then
+     */
+    bool push (T &object) noexcept
+    {
+        assert(owner(&(object.*Hook)) == std::addressof(object));
+        if (is_closed())
+        {
+            return false;
+        }
+        link(&(object.*Hook));
+        return true;
+    }
+
+    /**
+     * @brief Unlinks the first object.
+     *
+     * May report empty while a push is halfway done, pull again later.
+     *
+     * @returns the object, nullptr if there is none
+     */
+    T *pull () noexcept
+    {
+        mpsc_hook *tail = m_tail;
+        mpsc_hook *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &m_stub)
+        {
+            if (next == nullptr)
+            {
+                return nullptr;
+            }
+            // nikgub: skip the stub, it is back in line on the next drain
+            m_tail = next;
+            tail   = next;
+            next   = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr)
+        {
+            m_tail = next;
+            return owner(tail);
+        }
+        if (tail != m_head.load(std::memory_order_acquire))
+        {
+            return nullptr; // nikgub: a push swapped the head, not linked yet
+        }
+        // nikgub: tail is the last one, queue the stub behind it to free it
+        link(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr)
+        {
+            m_tail = next;
+            return owner(tail);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Hands up to max objects to a callable.
+     *
+     * @param func callable invoked as func(T&)
+     * @param max maximal amount of objects to consume
+     * @returns amount of objects consumed
+     */
+    template <std::invocable<T &> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            T *object = pull();
+            if (object == nullptr)
+            {
+                break;
+            }
+            ++count;
+            func(*object);
+        }
+        return count;
+    }
+
+    /**
+     * @brief Unlinks every object that is fully pushed.
+     *
+     * Consumer only.
+     */
+    void clear () noexcept
+    {
+        while (pull() != nullptr)
+        {
+        }
+    }
+
+    /**
+     * @brief Rejects all pushes from now on.
+     *
+     * Pushes that started before may still land, objects already queued
+     * stay and can be pulled. Safe from any thread, closing twice is fine.
+     */
+    void close () noexcept
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+  private:
+    static constexpr std::size_t field_alignment = Policy::field_alignment;
+
+    alignas(field_alignment) std::atomic<mpsc_hook *> m_head; // nikgub: newest
+    std::atomic<bool> m_closed{false}; // nikgub: producers read it anyway
+    alignas(field_alignment) mpsc_hook *m_tail; // nikgub: consumer only
+    mpsc_hook m_stub;
+
+  private:
+    void link (mpsc_hook *hook) noexcept
+    {
+        hook->next.store(nullptr, std::memory_order_relaxed);
+        mpsc_hook *prev = m_head.exchange(hook, std::memory_order_acq_rel);
+        prev->next.store(hook, std::memory_order_release);
+    }
+
+    /**
+     * @brief Maps a hook back to the object embedding it.
+     */
+    static T *owner (mpsc_hook *hook) noexcept
+    {
+        return reinterpret_cast<T *>(reinterpret_cast<std::byte *>(hook) -
+                                     hook_offset());
+    }
+
+    // nikgub: no T is ever built to measure on, and offsetof wants a name,
+    //         so read the offset out of the member pointer itself. Both the
+    //         Itanium and the MSVC ABI store a data member pointer of a
+    //         class without virtual bases as that offset, push() checks it
+    //         against a real object in debug builds
+    using offset_repr =
+        std::conditional_t<sizeof(Hook) == sizeof(std::int32_t),
+                           std::int32_t, std::ptrdiff_t>;
+    static_assert(sizeof(Hook) == sizeof(offset_repr),
+                  "unsupported member pointer representation");
+
+    /**
+     * @brief Offset of the hook inside T.
+     *
+     * memcpy is no constant expression, so the value is computed on first
+     * use rather than by a static initializer, which a queue used from
+     * another translation unit's static constructor could run before.
+     */
+    static std::ptrdiff_t hook_offset () noexcept
+    {
+        static const std::ptrdiff_t offset = []
+        {
+            const mpsc_hook T::*member = Hook;
+            offset_repr repr;
+            std::memcpy(&repr, &member, sizeof(repr));
+            return static_cast<std::ptrdiff_t>(repr);
+        }();
+        return offset;
+    }
+};
+
+} // namespace ngg
@@ -0,0 +1,313 @@
+#pragma once
+
+#include "mpsc_queue.hpp"
+#include "policy.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ngg
+{
+
+/**
+ * @brief Closed set of message types stored inline.
+ *
+ * Keeps the active alternative in a buffer sized and aligned for the
+ * largest of Ts, so a message never allocates on its own, and moves and
+ * destroys it through tables of function pointers indexed by the active
+ * alternative. Inside a message_queue the buffer is part of the node.
+ *
+ * @tparam Ts alternatives, move-constructible and distinct
+ */
+template <typename... Ts>
+    requires(sizeof...(Ts) > 0 && sizeof...(Ts) <= UINT8_MAX &&
+             (std::move_constructible<Ts> && ...))
+class message
+{
+  public:
+    static constexpr std::size_t inline_size      = std::max({sizeof(Ts)...});
+    static constexpr std::size_t inline_alignment = std::max({alignof(Ts)...});
+
+    /**
+     * @brief Index of M among Ts.
+     */
+    template <types::one_of<Ts...> M>
+    static constexpr std::uint8_t index_of = []
+    {
+        std::uint8_t i = 0;
+        // nikgub: stops at the first match, i counts the ones before it
+        (void)((!std::same_as<M, Ts> && (++i, true)) && ...);
+        return i;
+    }();
+
+    /**
+     * @brief Constructs an M in the inline buffer.
+     *
+     * @param args arguments forwarded to the constructor of M
+     */
+    template <types::one_of<Ts...> M, typename... Args>
+        requires std::constructible_from<M, Args...>
+    explicit message (std::in_place_type_t<M>, Args &&...args)
+        : m_index(index_of<M>)
+    {
+        std::construct_at(reinterpret_cast<M *>(m_storage),
+                          std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Moves the alternative of other, which stays moved-from.
+     */
+    message (message &&other) noexcept(nothrow_movable)
+        : m_index(other.m_index)
+    {
+        move_table[m_index](m_storage, other.m_storage);
+    }
+
+    message (const message &)            = delete;
+    message &operator= (const message &) = delete;
+    message &operator= (message &&)      = delete;
+
+    ~message ()
+    {
+        destroy_table[m_index](m_storage);
+    }
+
+    /**
+     * @brief Index of the active alternative.
+     */
+    std::size_t index () const noexcept
+    {
+        return m_index;
+    }
+
+    /**
+     * @brief Checks whether M is the active alternative.
+     */
+    template <types::one_of<Ts...> M>
+    bool holds () const noexcept
+    {
+        return m_index == index_of<M>;
+    }
+
+    /**
+     * @brief Accesses the alternative if it is an M.
+     *
+     * @returns pointer to the alternative, nullptr if another one is active
+     */
+    template <types::one_of<Ts...> M>
+    M *get_if () noexcept
+    {
+        return holds<M>() ? std::launder(reinterpret_cast<M *>(m_storage))
+                          : nullptr;
+    }
+
+    /**
+     * @brief Invokes func with the active alternative as an rvalue.
+     *
+     * Dispatch is a single indirect call through a table built at compile
+     * time for F.
+     *
+     * @param func callable invocable with every alternative
+     * @returns what func returns, converted to the common type
+     */
+    template <types::message_visitor<Ts...> F>
+    decltype(auto) visit (F &&func) &&
+    {
+        using result = std::common_type_t<std::invoke_result_t<F &, Ts &&>...>;
+        static constexpr std::array<result (*)(F &, void *), sizeof...(Ts)>
+            table{&visit_as<Ts, F, result>...};
+        return table[m_index](func, m_storage);
+    }
+
+  private:
+    static constexpr bool nothrow_movable =
+        (std::is_nothrow_move_constructible_v<Ts> && ...);
+
+    template <typename M>
+    static void destroy_as (void *p) noexcept
+    {
+        std::destroy_at(std::launder(static_cast<M *>(p)));
+    }
+
+    template <typename M>
+    static void move_as (void *to, void *from) noexcept(nothrow_movable)
+    {
+        std::construct_at(static_cast<M *>(to),
+                          std::move(*std::launder(static_cast<M *>(from))));
+    }
+
+    template <typename M, typename F, typename R>
+    static R visit_as (F &func, void *p)
+    {
+        return std::invoke(func, std::move(*std::launder(static_cast<M *>(p))));
+    }
+
+    static constexpr std::array<void (*)(void *) noexcept, sizeof...(Ts)>
+        destroy_table{&destroy_as<Ts>...};
+    static constexpr std::array<void (*)(void *, void *)
+                                    noexcept(nothrow_movable),
+                                sizeof...(Ts)>
+        move_table{&move_as<Ts>...};
+
+    alignas(inline_alignment) std::byte m_storage[inline_size];
+    std::uint8_t m_index;
+};
+
+/**
+ * @brief mpsc_queue of messages of a closed set of types.
+ *
+ * Only specialized for message<Ts...>.
+ */
+template <typename Message,
+          types::minimal_allocator_type<Message> Allocator =
+              std::allocator<Message>,
+          types::queue_policy Policy = policy::defaults>
+class message_queue;
+
+/**
+ * @brief multiple producers/single consumer queue of typed messages
+ *
+ * Built on mpsc_queue<message<Ts...>>, so the inline buffer of a message
+ * lives in the node itself: a push costs one node allocation and nothing
+ * else, none at all with policy::pooled, where a std::variant of
+ * heap-owning commands would allocate twice. The consumer hands every
+ * message to a visitor through message::visit.
+ *
+ * @tparam Ts message types
+ * @tparam Allocator allocator type, used for inner nodes
+ * @tparam Policy policy bundle, see policy::defaults
+ */
+template <typename... Ts, typename Allocator, typename Policy>
+class message_queue<message<Ts...>, Allocator, Policy>
+{
+  public:
+    using message_type = message<Ts...>;
+
+  protected:
+    using queue_type = mpsc_queue<message_type, Allocator, Policy>;
+
+  public:
+    message_queue () = default;
+
+    explicit message_queue (const Allocator &alloc) : m_queue(alloc)
+    {
+    }
+
+    message_queue (const message_queue &)            = delete;
+    message_queue &operator= (const message_queue &) = delete;
+
+    /**
+     * @brief Pushes a message, copied or moved into its node.
+     *
+     * @param value message of one of Ts
+     * @returns false if the queue is closed
+     */
+    template <typename M>
+        requires types::one_of<std::remove_cvref_t<M>, Ts...>
+    bool push (M &&value)
+    {
+        return m_queue.emplace(std::in_place_type<std::remove_cvref_t<M>>,
+                               std::forward<M>(value));
+    }
+
+    /**
+     * @brief Constructs a message of type M directly in its node.
+     *
+     * @param args arguments forwarded to the constructor of M
+     * @returns false if the queue is closed
+     */
+    template <types::one_of<Ts...> M, typename... Args>
+        requires std::constructible_from<M, Args...>
+    bool emplace (Args &&...args)
+    {
+        return m_queue.emplace(std::in_place_type<M>,
+                               std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Pops the first message.
+     *
+     * @returns the message if any, nullopt otherwise
+     */
+    std::optional<message_type> pull ()
+    {
+        return m_queue.pull();
+    }
+
+    /**
+     * @brief Pops the first message, blocking until there is one.
+     *
+     * @returns the message, nullopt if closed while empty
+     */
+    std::optional<message_type> pull_wait ()
+    {
+        return m_queue.pull_wait();
+    }
+
+    /**
+     * @brief Hands the first message to a visitor without moving it out.
+     *
+     * @param visitor callable invocable with every one of Ts
+     * @returns false if the queue was empty
+     */
+    template <types::message_visitor<Ts...> F>
+    bool pull (F &&visitor)
+    {
+        return consume_all(visitor, 1) == 1;
+    }
+
+    /**
+     * @brief Hands up to max messages to a visitor, in place.
+     *
+     * @param visitor callable invocable with every one of Ts
+     * @param max maximal amount of messages to consume
+     * @returns amount of messages consumed
+     */
+    template <types::message_visitor<Ts...> F>
+    std::size_t consume_all (F &&visitor, std::size_t max = SIZE_MAX)
+    {
+        return m_queue.consume_all([&visitor] (message_type &&m)
+                                   { std::move(m).visit(visitor); },
+                                   max);
+    }
+
+    /**
+     * @brief Clears all the messages in the queue.
+     *
+     * Consumer only.
+     */
+    void clear ()
+    {
+        m_queue.clear();
+    }
+
+    /**
+     * @brief Rejects all pushes from now on.
+     */
+    void close () noexcept
+    {
+        m_queue.close();
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_queue.is_closed();
+    }
+
+  private:
+    queue_type m_queue;
+};
+
+} // namespace ngg
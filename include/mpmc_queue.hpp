@@ -0,0 +1,395 @@
+#pragma once
+
+#include "node.hpp"
+#include "policy.hpp"
+#include "reclaim.hpp"
+#include "types.hpp"
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+
+namespace ngg
+{
+
+/**
+ * @brief multiple producers/multiple consumers queue
+ *
+ * Shares the node, the allocator rebinding and the node pools with
+ * mpsc_queue, and so does the push side: a push is still one exchange on
+ * the head. Consumers advance the tail with a CAS instead of a plain store,
+ * and the winner takes the value of the node it moved onto. Hazard
+ * pointers keep both the old and the new tail alive while a consumer looks
+ * at them by default, the old tail is retired rather than freed and
+ * reclaimed in batches once no consumer protects it. policy::epoch_reclaimed
+ * trades the per-pointer hazards for one store per element.
+ *
+ * Elements of one producer keep their order. Only node_pool, reclaim and
+ * field_alignment of Policy are used, reclaim::immediate is replaced by
+ * hazard pointers. This is the only queue that needs Policy::reclaim, the
+ * queue_policy concept leaves it out.
+ *
+ * @tparam T type of inner data
+ * @tparam Allocator allocator type, used for inner nodes
+ * @tparam Policy policy bundle with a reclaim member, see policy::defaults
+ */
+template <types::queue_element T,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::defaults>
+    requires types::reclaim_policy<typename Policy::reclaim>
+class mpmc_queue
+{
+  protected:
+    using pool_policy      = typename Policy::node_pool;
+    using node             = detail::list_node<T, typename pool_policy::hook>;
+    using pointer          = node *;
+    using atomic_node      = std::atomic<node *>;
+    using allocator_traits = typename std::allocator_traits<Allocator>;
+    using node_allocator   = allocator_traits::template rebind_alloc<node>;
+    using node_pool =
+        typename pool_policy::template pool<node, node_allocator>;
+    // nikgub: freeing on the spot is never sound with several consumers
+    using reclaim_policy =
+        std::conditional_t<Policy::reclaim::deferred,
+                           typename Policy::reclaim,
+                           reclaim::hazard_pointers<>>;
+    using reclaimer = typename reclaim_policy::template domain<node>;
+
+  public:
+    /**
+     * @brief Constructs the queue.
+     */
+    mpmc_queue () : mpmc_queue(Allocator())
+    {
+    }
+
+    /**
+     * @brief Constructs the queue with a given allocator.
+     *
+     * Nodes are freed by whichever consumer reclaims them, so a stateful
+     * allocator must tolerate deallocation from any thread.
+     *
+     * @param alloc allocator the node allocator is converted from
+     */
+    explicit mpmc_queue (const Allocator &alloc) : m_node_alloc(alloc)
+    {
+        pointer dummy = m_pool.create(m_node_alloc, nullptr);
+        m_head.store(dummy, std::memory_order_relaxed);
+        m_tail.store(dummy, std::memory_order_relaxed);
+    }
+
+    mpmc_queue (const mpmc_queue &)            = delete;
+    mpmc_queue &operator= (const mpmc_queue &) = delete;
+
+    /**
+     * @brief Destroys the queue and every element still in it.
+     *
+     * Must not race with anything.
+     */
+    ~mpmc_queue ()
+    {
+        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+        pointer next     = tail_ptr->next.load(std::memory_order_acquire);
+        m_pool.destroy(m_node_alloc, tail_ptr);
+        while (next != nullptr)
+        {
+            pointer after = next->next.load(std::memory_order_acquire);
+            std::destroy_at(std::addressof(next->data));
+            m_pool.destroy(m_node_alloc, next);
+            next = after;
+        }
+        m_reclaim.release(free_node());
+        m_pool.purge(m_node_alloc);
+    }
+
+    /**
+     * @brief Copies and pushes a value to the queue.
+     *
+     * @param value value being copied
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (const T &value)
+    {
+        return emplace(value);
+    }
+
+    /**
+     * @brief Pushes an rvalue to the queue.
+     *
+     * @param value value being forwarded
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (T &&value)
+    {
+        return emplace(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place at the end of the queue.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace (Args &&...args)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        pointer new_node = make_node(std::forward<Args>(args)...);
+        link_chain(new_node, new_node);
+        return true;
+    }
+
+    /**
+     * @brief Pushes a range of values with a single exchange.
+     *
+     * If constructing an element throws, nothing is pushed.
+     *
+     * @param first iterator to the first value
+     * @param last sentinel of the range
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    template <std::input_iterator InputIt, std::sentinel_for<InputIt> Sentinel>
+        requires std::constructible_from<T, std::iter_reference_t<InputIt>>
+    bool push_bulk (InputIt first, Sentinel last)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        pointer chain_head = nullptr;
+        pointer chain_tail = nullptr;
+        try
+        {
+            for (; first != last; ++first)
+            {
+                pointer new_node = make_node(*first);
+                if (chain_tail == nullptr)
+                {
+                    chain_head = new_node;
+                }
+                else
+                {
+                    chain_tail->next.store(new_node, std::memory_order_relaxed);
+                }
+                chain_tail = new_node;
+            }
+        }
+        catch (...)
+        {
+            while (chain_head != nullptr)
+            {
+                pointer next = chain_head->next.load(std::memory_order_relaxed);
+                std::destroy_at(std::addressof(chain_head->data));
+                m_pool.destroy(m_node_alloc, chain_head);
+                chain_head = next;
+            }
+            throw;
+        }
+        if (chain_head != nullptr)
+        {
+            link_chain(chain_head, chain_tail);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Pushes a range of values with a single exchange.
+     *
+     * Elements of an rvalue range are moved from.
+     *
+     * @param range range of values
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    template <std::ranges::input_range Range>
+    bool push_bulk (Range &&range)
+    {
+        if constexpr (std::is_lvalue_reference_v<Range>)
+        {
+            return push_bulk(std::ranges::begin(range),
+                             std::ranges::end(range));
+        }
+        else
+        {
+            return push_bulk(
+                std::make_move_iterator(std::ranges::begin(range)),
+                std::move_sentinel(std::ranges::end(range)));
+        }
+    }
+
+    /**
+     * @brief Pops the first element from the queue, any thread.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        std::optional<T> result;
+        consume_all([&result] (T &&value) { result.emplace(std::move(value)); },
+                    1);
+        return result;
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable, any thread.
+     *
+     * Other consumers may take elements in between, so the ones a call
+     * sees are in order but not necessarily adjacent.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            // nikgub: pinned per element so a long call never stalls epochs
+            typename reclaimer::guard guard = m_reclaim.pin();
+            if (!take(guard, func))
+            {
+                break;
+            }
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Pops and destroys every element that is fully pushed.
+     */
+    void clear ()
+    {
+        consume_all([] (T &&) {});
+    }
+
+    /**
+     * @brief Rejects all pushes from now on.
+     *
+     * Pushes that started before may still land, elements already queued
+     * stay and can be pulled. Safe from any thread, closing twice is fine.
+     */
+    void close () noexcept
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+  private:
+    static constexpr std::size_t field_alignment = Policy::field_alignment;
+
+    alignas(field_alignment) atomic_node m_head; // nikgub: newest node
+    std::atomic<bool> m_closed{false}; // nikgub: producers read it anyway
+    alignas(field_alignment) atomic_node m_tail; // nikgub: sentinel, CASed
+    alignas(field_alignment) reclaimer m_reclaim;
+    [[no_unique_address]] node_allocator m_node_alloc;
+    [[no_unique_address]] node_pool m_pool;
+
+  private:
+    struct free_node_fn
+    {
+        mpmc_queue *queue;
+
+        void operator() (pointer p) const
+        {
+            queue->m_pool.destroy(queue->m_node_alloc, p);
+        }
+    };
+
+    free_node_fn free_node () noexcept
+    {
+        return free_node_fn{this};
+    }
+
+    template <typename... Args>
+    pointer make_node (Args &&...args)
+    {
+        pointer new_node = m_pool.create(m_node_alloc, nullptr);
+        try
+        {
+            std::construct_at(std::addressof(new_node->data),
+                              std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            m_pool.destroy(m_node_alloc, new_node);
+            throw;
+        }
+        return new_node;
+    }
+
+    /**
+     * @brief Splices a privately built chain [first, last] in.
+     *
+     * The previous head cannot be reclaimed in between: a consumer only
+     * moves past a node once its next is set, which is this store.
+     */
+    void link_chain (pointer first, pointer last)
+    {
+        pointer prev_head = m_head.exchange(last, std::memory_order_acq_rel);
+        prev_head->next.store(first, std::memory_order_release);
+    }
+
+    /**
+     * @brief Moves the tail one node ahead and consumes that node's value.
+     *
+     * Hazard 0 protects the tail being read, hazard 1 the node taken, which
+     * becomes the new sentinel and may be passed and retired by another
+     * consumer while func still runs. The CAS succeeding proves the node
+     * was not retired before hazard 1 was published. Under epochs both
+     * hazards are no-ops and the pinned guard covers everything.
+     *
+     * @returns false if the queue looked empty
+     */
+    template <typename F>
+    bool take (typename reclaimer::guard &guard, F &func)
+    {
+        pointer tail_ptr;
+        pointer next;
+        do
+        {
+            tail_ptr = guard.protect(0, m_tail);
+            next     = tail_ptr->next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                return false;
+            }
+            guard.set(1, next);
+        } while (!m_tail.compare_exchange_strong(tail_ptr, next,
+                                                 std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed));
+        try
+        {
+            func(std::move(next->data));
+        }
+        catch (...)
+        {
+            std::destroy_at(std::addressof(next->data));
+            m_reclaim.retire(tail_ptr, free_node());
+            throw;
+        }
+        std::destroy_at(std::addressof(next->data));
+        m_reclaim.retire(tail_ptr, free_node());
+        return true;
+    }
+};
+
+} // namespace ngg
@@ -1,37 +1,105 @@
 #pragma once
 
+#include "node.hpp"
+#include "node_reserve.hpp"
+#include "parking.hpp"
+#include "policy.hpp"
 #include "types.hpp"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <optional>
+#include <ranges>
+#include <stop_token>
+#include <type_traits>
 #include <utility>
 
 namespace ngg
 {
 
+namespace detail
+{
+
+/**
+ * @brief Memory orders of the handshakes in mpsc_queue.
+ *
+ * tests/model_checks.cpp explores its models with exactly these, so any
+ * change here is checked against the model before it can ship.
+ */
+struct mpsc_orders
+{
+    // nikgub: push, m_head.exchange in link_chain, seq_cst for the wake
+    static constexpr std::memory_order link_exchange =
+        std::memory_order_seq_cst;
+    // nikgub: push, prev_head->next.store publishes the chain
+    static constexpr std::memory_order link_publish = std::memory_order_release;
+    // nikgub: pull, tail->next.load acquires the element
+    static constexpr std::memory_order pull_next = std::memory_order_acquire;
+    // nikgub: push, m_waiting.load in link_chain after the exchange
+    static constexpr std::memory_order wake_check = std::memory_order_seq_cst;
+    // nikgub: consumer or close(), setting a bit in m_waiting
+    static constexpr std::memory_order park_announce =
+        std::memory_order_seq_cst;
+    // nikgub: consumer, m_head.load after announcing
+    static constexpr std::memory_order park_recheck = std::memory_order_seq_cst;
+    // nikgub: push, taking a wake-up bit back out of m_waiting
+    static constexpr std::memory_order wake_claim = std::memory_order_acq_rel;
+};
+
+} // namespace detail
+
 /**
  * @brief multiple producers/single consumer queue
  *
- * Implement Michael-Scott queue, is intrusive and unbound.
- * Uses dummy sentinel node for initial head and tail.
+ * Implement Michael-Scott queue, is unbound and owns its nodes, values
+ * are copied or moved in. See intrusive_mpsc_queue to link user-owned
+ * objects without allocating.
+ * Uses dummy sentinel node for initial head and tail, the sentinel holds no
+ * value so T does not need to be default-constructible.
+ * Only the consumer dereferences a node once it is linked, so the old
+ * sentinel goes straight back to the node pool. Policy::reclaim is not used
+ * here, it is for mpmc_queue, whose consumers race on the tail.
  *
- * @tparam T type of inner data, must be default-constructible
+ * @tparam T type of inner data
  * @tparam Allocator allocator type, used for inner nodes
+ * @tparam Policy policy bundle, see policy::defaults
  */
-template <types::default_constructible T,
-          types::minimal_allocator_type<T> Allocator = std::allocator<T>>
+template <types::queue_element T,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::defaults>
 class mpsc_queue
 {
     // nikgub: semantics, a must-have
   protected:
-    struct node;
+    using pool_policy      = typename Policy::node_pool;
+    using tracing_policy   = typename Policy::tracing;
+    using node             = detail::list_node<T, typename pool_policy::hook,
+                                               typename tracing_policy::stamp>;
     using value_type       = T;
     using pointer          = node *;
+    using orders           = detail::mpsc_orders;
     using atomic_node      = std::atomic<node *>;
     using allocator_traits = typename std::allocator_traits<Allocator>;
     using node_allocator   = allocator_traits::template rebind_alloc<node>;
     using node_allocator_traits =
         typename std::allocator_traits<node_allocator>;
+    using node_pool =
+        typename pool_policy::template pool<node, node_allocator>;
+    using stats_policy    = typename Policy::stats;
+    using stats_recorder  = typename stats_policy::recorder;
+    using notifier_policy = typename Policy::notifier;
+    using notifier_handle = typename notifier_policy::handle;
+    using capacity_policy = typename Policy::capacity;
+    using capacity_gate   = typename capacity_policy::gate;
+    using tracer          = typename tracing_policy::tracer;
 
   public:
     /**
@@ -39,13 +107,44 @@ class mpsc_queue
      *
      * Inits the head and tail nodes with a dummy node.
      */
-    mpsc_queue () : m_node_alloc()
+    mpsc_queue () : mpsc_queue(Allocator())
+    {
+    }
+
+    /**
+     * @brief Constructs the queue with a given allocator.
+     *
+     * The allocator is rebound to the node type, which is how stateful
+     * allocators such as std::pmr::polymorphic_allocator are plugged in.
+     *
+     * @param alloc allocator the node allocator is converted from
+     */
+    explicit mpsc_queue (const Allocator &alloc) : m_node_alloc(alloc)
     {
-        pointer dummy = node_allocator_traits::allocate(m_node_alloc, 1);
-        node_allocator_traits::construct(m_node_alloc, dummy, nullptr);
+        pointer dummy = m_pool.create(m_node_alloc, nullptr);
         // nikgub: relaxed memory since we do not contest anything yet
         m_head.store(dummy, std::memory_order_relaxed);
         m_tail.store(dummy, std::memory_order_relaxed);
+        if constexpr (notifier_policy::enabled)
+        {
+            // nikgub: armed from the start, the first push notifies
+            m_waiting.store(notify_armed, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Constructs the queue with a reserve of capacity nodes.
+     *
+     * Same as constructing it and calling reserve(capacity).
+     *
+     * @param capacity amount of nodes to reserve
+     * @param alloc allocator the node allocator is converted from
+     */
+    explicit mpsc_queue (std::size_t capacity,
+                         const Allocator &alloc = Allocator())
+        : mpsc_queue(alloc)
+    {
+        reserve(capacity);
     }
 
     /**
@@ -56,32 +155,186 @@ class mpsc_queue
     ~mpsc_queue ()
     {
         clear();
-        node_allocator_traits::destroy(m_node_alloc, m_head.load());
-        node_allocator_traits::deallocate(m_node_alloc, m_tail.load(), 1);
+        destroy_node(m_tail.load(std::memory_order_relaxed));
+        m_pool.purge(m_node_alloc);
     }
 
     /**
      * @brief Copies and pushes a value to the queue.
      *
-     * Implemented as forwarding.
+     * Implemented as forwarding. With a capacity policy, waits for room
+     * while the queue is full.
      *
      * @param value value being copied
+     * @returns false if the queue is closed, nothing is pushed then
      */
-    void push (const T &value)
+    bool push (const T &value)
     {
-        push_impl(T(value));
+        return push_impl(value);
     }
 
     /**
      * @brief Pushes an rvalue to the queue.
      *
-     * Implemented as forwarding.
+     * Implemented as forwarding. A rejected value is left untouched.
      *
      * @param value value being forwarded
+     * @returns false if the queue is closed, nothing is pushed then
      */
-    void push (T &&value)
+    bool push (T &&value)
     {
-        push_impl(value);
+        return push_impl(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place at the end of the queue.
+     *
+     * The value is built directly inside its node, no temporary is made.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace (Args &&...args)
+    {
+        return push_impl(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Copies and pushes a value unless the queue is full.
+     *
+     * Never waits. Without a capacity policy this is push().
+     *
+     * @param value value being copied
+     * @returns false if the queue is full or closed
+     */
+    bool try_push (const T &value)
+    {
+        return try_push_impl(value);
+    }
+
+    /**
+     * @brief Pushes an rvalue unless the queue is full.
+     *
+     * A rejected value is left untouched.
+     *
+     * @param value value being forwarded
+     * @returns false if the queue is full or closed
+     */
+    bool try_push (T &&value)
+    {
+        return try_push_impl(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place unless the queue is full.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is full or closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool try_emplace (Args &&...args)
+    {
+        return try_push_impl(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Pushes a range of values with a single exchange.
+     *
+     * Nodes are built into a private chain first, then spliced in at once.
+     * If constructing an element throws, nothing is pushed. With a
+     * capacity policy the whole range is admitted at once, before building
+     * if its size is known, after otherwise: elements of an unsized rvalue
+     * range are then lost if the queue closes while waiting for room. A
+     * soft capacity is checked once for the whole range, which may take
+     * the queue past its limit by up to the size of the range.
+     *
+     * @param first iterator to the first value
+     * @param last sentinel of the range
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    template <std::input_iterator InputIt, std::sentinel_for<InputIt> Sentinel>
+        requires std::constructible_from<T, std::iter_reference_t<InputIt>>
+    bool push_bulk (InputIt first, Sentinel last)
+    {
+        constexpr bool sized = std::sized_sentinel_for<Sentinel, InputIt>;
+        std::size_t admitted = 0;
+        if (is_closed())
+        {
+            return false;
+        }
+        if constexpr (sized)
+        {
+            admitted = static_cast<std::size_t>(last - first);
+            if (admitted != 0 && !admit(admitted))
+            {
+                return false;
+            }
+        }
+        pointer chain_head = nullptr;
+        pointer chain_tail = nullptr;
+        std::size_t count  = 0;
+        try
+        {
+            for (; first != last; ++first)
+            {
+                pointer new_node = make_node(*first);
+                if (chain_tail == nullptr)
+                {
+                    chain_head = new_node;
+                }
+                else
+                {
+                    chain_tail->next.store(new_node, std::memory_order_relaxed);
+                }
+                chain_tail = new_node;
+                ++count;
+            }
+        }
+        catch (...)
+        {
+            discard_chain(chain_head);
+            m_gate.cancel(admitted);
+            throw;
+        }
+        if (chain_head == nullptr)
+        {
+            return true;
+        }
+        if (!sized && !admit(count))
+        {
+            discard_chain(chain_head);
+            return false;
+        }
+        m_stats.on_push(count);
+        link_chain(chain_head, chain_tail);
+        return true;
+    }
+
+    /**
+     * @brief Pushes a range of values with a single exchange.
+     *
+     * Elements of an rvalue range are moved from.
+     *
+     * @param range range of values
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    template <std::ranges::input_range Range>
+    bool push_bulk (Range &&range)
+    {
+        if constexpr (std::is_lvalue_reference_v<Range>)
+        {
+            return push_bulk(std::ranges::begin(range),
+                             std::ranges::end(range));
+        }
+        else
+        {
+            return push_bulk(
+                std::make_move_iterator(std::ranges::begin(range)),
+                std::move_sentinel(std::ranges::end(range)));
+        }
     }
 
     /**
@@ -93,86 +346,562 @@ class mpsc_queue
     {
         pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
         // nikgub: acquire the element
-        pointer next     = tail_ptr->next.load(std::memory_order_acquire);
+        pointer next     = tail_ptr->next.load(orders::pull_next);
         if (next == nullptr) // nikgub: nullopt if none
         {
+            m_stats.on_empty_poll();
+            m_gate.on_idle();
             return std::nullopt;
         }
-        T result = std::move(next->data);
+        m_stats.on_pull(1);
+        m_gate.on_pull(1);
+        m_tracer.on_pull(next->trace_stamp);
+        std::optional<T> result(std::move(next->data));
+        // nikgub: next becomes the new sentinel, its value is gone
+        std::destroy_at(std::addressof(next->data));
         m_tail.store(next, std::memory_order_release);
-        node_allocator_traits::destroy(m_node_alloc, tail_ptr);
-        node_allocator_traits::deallocate(m_node_alloc, tail_ptr, 1);
+        destroy_node(tail_ptr);
         return result;
     }
 
+    /**
+     * @brief Pops the first element into out.
+     *
+     * The cheap pull for small trivially copyable types such as integers
+     * or pointers, no optional is built and the value is copied once.
+     *
+     * @param out assigned the value if there is one, untouched otherwise
+     * @returns false if the queue was empty
+     */
+    bool try_pull (T &out)
+        requires std::is_nothrow_move_assignable_v<T>
+    {
+        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+        // nikgub: acquire the element, the only load of next on this path
+        pointer next = tail_ptr->next.load(orders::pull_next);
+        if (next == nullptr)
+        {
+            m_stats.on_empty_poll();
+            m_gate.on_idle();
+            return false;
+        }
+        m_stats.on_pull(1);
+        m_gate.on_pull(1);
+        m_tracer.on_pull(next->trace_stamp);
+        out = std::move(next->data);
+        std::destroy_at(std::addressof(next->data));
+        m_tail.store(next, std::memory_order_release);
+        destroy_node(tail_ptr);
+        return true;
+    }
+
+    /**
+     * @brief Accesses the first element in place.
+     *
+     * The element stays in the queue until pop(), so large values can be
+     * processed without moving them out. Consumer only.
+     *
+     * @returns pointer to the first element, nullptr if there is none
+     */
+    T *front () noexcept
+    {
+        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+        // nikgub: acquire the element
+        pointer next = tail_ptr->next.load(orders::pull_next);
+        return next == nullptr ? nullptr : std::addressof(next->data);
+    }
+
+    /**
+     * @brief Destroys the first element, the one front() points to.
+     *
+     * Consumer only.
+     *
+     * @returns false if the queue was empty
+     */
+    bool pop ()
+    {
+        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+        pointer next     = tail_ptr->next.load(orders::pull_next);
+        if (next == nullptr)
+        {
+            m_stats.on_empty_poll();
+            m_gate.on_idle();
+            return false;
+        }
+        m_stats.on_pull(1);
+        m_gate.on_pull(1);
+        m_tracer.on_pull(next->trace_stamp);
+        std::destroy_at(std::addressof(next->data));
+        m_tail.store(next, std::memory_order_release);
+        destroy_node(tail_ptr);
+        return true;
+    }
+
+    /**
+     * @brief Pops the first element, blocking until there is one.
+     *
+     * Spins for an adaptive amount of polls first, then parks on a futex.
+     * Producers only pay for a wake-up when the consumer actually parked.
+     *
+     * @returns the popped value, nullopt if closed while empty
+     */
+    std::optional<T> pull_wait ()
+    {
+        return wait_impl(
+            [this] (std::uint32_t expected)
+            {
+                detail::park(m_waiting, expected);
+                return true;
+            });
+    }
+
+    /**
+     * @brief Pops the first element, blocking until there is one or stop
+     * is requested on token.
+     *
+     * @param token stop token that interrupts the wait
+     * @returns value if any, nullopt if stopped or closed while empty
+     */
+    std::optional<T> pull_wait (std::stop_token token)
+    {
+        // nikgub: destroyed after on_stop, the callback is gone by then and
+        //         nobody else sets the bit; T need not be move-assignable
+        struct stop_reset
+        {
+            std::atomic<std::uint32_t> &waiting;
+
+            ~stop_reset ()
+            {
+                waiting.fetch_and(~stop_requested, std::memory_order_relaxed);
+            }
+        } reset{m_waiting};
+        std::stop_callback on_stop(token, [this] { interrupt_wait(); });
+        return wait_impl(
+            [this] (std::uint32_t expected)
+            {
+                detail::park(m_waiting, expected);
+                return true;
+            });
+    }
+
+    /**
+     * @brief Pops the first element, blocking for at most timeout.
+     *
+     * @param timeout maximal time to wait
+     * @returns value if any, nullopt on timeout or if closed while empty
+     */
+    template <typename Rep, typename Period>
+    std::optional<T>
+    pull_wait_for (const std::chrono::duration<Rep, Period> &timeout)
+    {
+        return pull_wait_until(std::chrono::steady_clock::now() + timeout);
+    }
+
+    /**
+     * @brief Pops the first element, blocking until deadline at most.
+     *
+     * @param deadline point in time to give up at
+     * @returns value if any, nullopt on timeout or if closed while empty
+     */
+    template <typename Clock, typename Duration>
+    std::optional<T>
+    pull_wait_until (const std::chrono::time_point<Clock, Duration> &deadline)
+    {
+        return wait_impl(
+            [this, &deadline] (std::uint32_t expected)
+            {
+                const auto remaining = deadline - Clock::now();
+                if (remaining <= remaining.zero())
+                {
+                    return false;
+                }
+                detail::park_for(m_waiting, expected, remaining);
+                return true;
+            });
+    }
+
+    /**
+     * @brief Awaitable that pops the next element.
+     *
+     * co_await queue.next() completes at once if an element is there and
+     * suspends the consumer coroutine otherwise. The producer whose push
+     * ends the wait resumes the coroutine inline on its own thread, which
+     * is the lowest latency handoff there is but runs consumer code on the
+     * producer. Only one wait, coroutine or blocking, may be pending, and
+     * the queue must outlive a suspended consumer.
+     *
+     * @returns awaitable yielding std::optional<T>, nullopt once closed
+     * and empty
+     */
+    auto next ()
+    {
+        return awaiter<inline_resume>(*this, inline_resume{});
+    }
+
+    /**
+     * @brief Awaitable that pops the next element, resuming on scheduler.
+     *
+     * As next(), but the waking producer hands the coroutine handle to
+     * scheduler instead of resuming it, e.g. to post it to the executor the
+     * consumer belongs to. The scheduler is copied into the awaitable, pass
+     * a std::reference_wrapper for ones that must not be copied.
+     *
+     * @param scheduler callable invoked as scheduler(handle)
+     * @returns awaitable yielding std::optional<T>, nullopt once closed
+     * and empty
+     */
+    template <types::coroutine_scheduler Scheduler>
+    auto next (Scheduler &&scheduler)
+    {
+        return awaiter<std::decay_t<Scheduler>>(
+            *this, std::forward<Scheduler>(scheduler));
+    }
+
+    /**
+     * @brief Pops up to max elements into an output iterator.
+     *
+     * Walks the chain once and publishes the tail a single time at the end.
+     *
+     * @param out iterator the values are moved into
+     * @param max maximal amount of elements to pop
+     * @returns amount of elements popped
+     */
+    template <std::output_iterator<T> OutputIt>
+    std::size_t pull_bulk (OutputIt out, std::size_t max)
+    {
+        return consume_all([&out] (T &&value) { *out++ = std::move(value); },
+                           max);
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable.
+     *
+     * The callable receives an rvalue reference to the element inside its
+     * node, so nothing is moved unless the callable does it. The tail is
+     * published once per call, retired nodes are freed after that.
+     * If the callable throws, the elements it already received are retired
+     * and the exception is propagated.
+     * While an element is handled the next Policy::prefetch_distance nodes
+     * of the chain are prefetched, hiding the pointer chase.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        return consume_until(func, max, nullptr);
+    }
+
+    /**
+     * @brief Hands every element pushed before the call to a callable.
+     *
+     * Takes a snapshot of the head and consumes up to it, waiting for
+     * pushes that were in flight at that point to land. Concurrent
+     * producers can neither starve it nor make it miss an element pushed
+     * before it started, so after close() and a drain() only pushes that
+     * raced close() itself can still arrive. Consumer only.
+     *
+     * @param func callable invoked as func(T&&)
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t drain (F &&func)
+    {
+        return consume_until(func, SIZE_MAX,
+                             m_head.load(std::memory_order_acquire));
+    }
+
+    /**
+     * @brief Destroys every element pushed before the call.
+     *
+     * Same guarantees as drain(F&&). Consumer only.
+     *
+     * @returns amount of elements destroyed
+     */
+    std::size_t drain ()
+    {
+        return drain([] (T &&) {});
+    }
+
     /**
      * @brief Clears all the elements in the queue.
      *
-     * TODO: this is somewhat hacky, theoretically there can be a situation when
-     * the tail_ptr removes a dummy node but this is so unlikely it is basically
-     * a no-op.
+     * Equivalent to drain(). Consumer only.
      */
     void clear ()
     {
-        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
-        while (true)
+        drain();
+    }
+
+    /**
+     * @brief Rejects all pushes from now on and wakes the consumer.
+     *
+     * Pushes that started before may still land, elements already queued
+     * stay and can be pulled. Blocking and coroutine waits return nullopt
+     * once the queue is closed and empty, a push that was accepted but is
+     * still linking counts as queued and is waited for. Safe from any
+     * thread, closing twice is fine.
+     */
+    void close () noexcept
+    {
+        const std::uint32_t state =
+            m_waiting.fetch_or(queue_closed, orders::park_announce);
+        if (state & queue_closed)
         {
-            pointer next = tail_ptr->next.load(std::memory_order_acquire);
-            if (next == nullptr)
+            return;
+        }
+        m_gate.wake_all();
+        if (state & consumer_parked)
+        {
+            detail::unpark_one(m_waiting);
+        }
+        else if (state & coroutine_parked)
+        {
+            resume_consumer();
+        }
+        if constexpr (notifier_policy::enabled)
+        {
+            if (state & notify_armed)
             {
-                break;
+                notify_consumer();
             }
-            m_tail.store(next, std::memory_order_release);
-            node_allocator_traits::destroy(m_node_alloc, tail_ptr);
-            node_allocator_traits::deallocate(m_node_alloc, tail_ptr, 1);
-            tail_ptr = next;
         }
     }
 
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_waiting.load(std::memory_order_acquire) & queue_closed;
+    }
+
+    /**
+     * @brief Reserves pre-faulted memory for at least n nodes.
+     *
+     * The nodes are carved out of one mapping, huge-page backed if
+     * huge_pages and the kernel allows it, whose pages are all faulted in
+     * here. Pushes take nodes from it first and fall back to the node pool
+     * and the allocator only when it is exhausted, popped nodes go back to
+     * it. Only the first call reserves anything, and it must happen before
+     * the queue is shared, usually right after construction.
+     *
+     * @param n amount of nodes to reserve
+     * @param huge_pages whether to ask for huge pages
+     * @returns amount of nodes reserved, rounded up to whole pages
+     */
+    std::size_t reserve (std::size_t n, bool huge_pages = true)
+    {
+        return m_reserve.map(n, huge_pages);
+    }
+
+    /**
+     * @brief Amount of nodes reserved by reserve(), zero if none.
+     */
+    std::size_t reserved () const noexcept
+    {
+        return m_reserve.capacity();
+    }
+
+    /**
+     * @brief Returns a snapshot of the queue counters.
+     *
+     * Only available with an enabled stats policy, safe from any thread.
+     */
+    queue_stats stats () const
+        requires stats_policy::enabled
+    {
+        return m_stats.snapshot();
+    }
+
+    /**
+     * @brief Returns a snapshot of the queueing delay histogram.
+     *
+     * Only available with an enabled tracing policy such as policy::traced,
+     * safe from any thread and never stops the consumer. Values are in
+     * detail::ticks() units, from the push of a sampled element to its pull.
+     */
+    auto latency () const
+        requires tracing_policy::enabled
+    {
+        return m_tracer.snapshot();
+    }
+
+    /**
+     * @brief Estimated amount of elements in the queue.
+     *
+     * Only available with a stats policy that tracks depth, such as
+     * policy::sized or policy::instrumented. Pushes and pulls only touch
+     * counters owned by the calling thread, this sums them without
+     * stopping anybody, from any thread. The result is exact while the
+     * queue is quiescent. Under traffic it is the depth at some point during
+     * the call, give or take the pushes and pulls in flight. Pushes are
+     * counted just before they are linked, so it may run slightly ahead of
+     * what pull() can see, and it never goes below zero.
+     */
+    std::size_t approx_size () const noexcept
+        requires requires(const stats_recorder &recorder) {
+            { recorder.depth() } -> std::convertible_to<std::size_t>;
+        }
+    {
+        return static_cast<std::size_t>(m_stats.depth());
+    }
+
+    /**
+     * @brief Descriptor that turns readable when the queue has elements.
+     *
+     * Only available with an enabled notifier policy. Notifications are
+     * coalesced: after one fires, no push writes to the descriptor again
+     * until the consumer calls rearm().
+     */
+    int native_handle () const noexcept
+        requires notifier_policy::enabled
+    {
+        return m_notifier.native_handle();
+    }
+
+    /**
+     * @brief Re-enables notifications after draining, consumer only.
+     *
+     * Resets the descriptor, arms the notifier and re-checks the queue with
+     * the same handshake the blocking waits use. The usual loop on every
+     * readiness event is
+     *
+     *     do { queue.consume_all(handler); } while (!queue.rearm());
+     *
+     * @returns true if the queue is empty and the descriptor will fire on
+     * the next push, false if elements arrived and must be drained first
+     */
+    bool rearm () noexcept
+        requires notifier_policy::enabled
+    {
+        m_notifier.reset();
+        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+        // nikgub: seq_cst pairs with the load in link_chain
+        m_waiting.fetch_or(notify_armed, orders::park_announce);
+        if (m_head.load(orders::park_recheck) == tail_ptr)
+        {
+            return true;
+        }
+        // nikgub: a push raced us, if it already fired we get a spurious
+        //         readiness later, which is harmless
+        m_waiting.fetch_and(~notify_armed, std::memory_order_relaxed);
+        return false;
+    }
+
   protected:
     /**
-     * @brief Inner node struct of mpsc_queue.
+     * @brief Suspended consumer coroutine and how to resume it.
+     */
+    struct waiter
+    {
+        std::coroutine_handle<> handle;
+        void (*resume)(void *, std::coroutine_handle<>) = nullptr;
+        void *context                                  = nullptr;
+    };
+
+    struct inline_resume
+    {
+        void operator() (std::coroutine_handle<> handle) const
+        {
+            handle.resume();
+        }
+    };
+
+    /**
+     * @brief Awaitable returned by next().
      *
-     * Owns the inner data.
+     * Lives in the consumer's coroutine frame, which outlives the
+     * suspension, so the queue keeps a plain pointer to it.
      */
-    struct node
+    template <typename Resume>
+    class awaiter
     {
-        /**
-         * @brief Argument constructor.
-         *
-         * Constructs inner data from an arg, sets the next pointer.
-         */
-        explicit node (node *next, T value)
-            : data(std::forward<T>(value)), next(next)
+      public:
+        awaiter (mpsc_queue &queue, Resume resume)
+            : m_queue(queue), m_resume(std::move(resume))
         {
         }
 
-        /**
-         * @brief No-arg constructor.
-         *
-         * Default-constructs the inner value, sets the next pointer.
-         */
-        explicit node (node *next) : data(), next(next)
+        bool await_ready ()
         {
+            m_result = m_queue.pull();
+            return m_result.has_value() || m_queue.closed_and_drained();
+        }
+
+        bool await_suspend (std::coroutine_handle<> handle)
+        {
+            return m_queue.suspend_consumer({handle, &awaiter::resume, this});
+        }
+
+        std::optional<T> await_resume ()
+        {
+            while (!m_result)
+            {
+                // nikgub: either a producer resumed us after linking, or we
+                //         saw its push in flight, both land right away,
+                //         unless it is close() that woke us
+                m_result = m_queue.pull();
+                if (!m_result)
+                {
+                    if (m_queue.closed_and_drained())
+                    {
+                        break;
+                    }
+                    detail::cpu_relax();
+                }
+            }
+            return std::move(m_result);
         }
 
-        node () : data(), next(nullptr)
+      private:
+        static void resume (void *self, std::coroutine_handle<> handle)
         {
+            // nikgub: the scheduler may run the coroutine before returning,
+            //         which may destroy this awaiter, so own the callable
+            Resume resume = std::move(static_cast<awaiter *>(self)->m_resume);
+            std::invoke(resume, handle);
         }
 
-        T data;
-        atomic_node next;
+        mpsc_queue &m_queue;
+        [[no_unique_address]] Resume m_resume;
+        std::optional<T> m_result;
     };
 
   private:
-    // nikgub: align for 64 bytes for x86_64.
-    //         do this to prevent false sharing.
-    //         if someone uses 32-bit system - shame on them.
-    //         TODO: maybe fix this?
-    alignas(64) atomic_node m_head; // nikgub: newest node
-    alignas(64) atomic_node m_tail; // nikgub: oldest node
-    alignas(64) node_allocator
+    // nikgub: align to prevent false sharing, the policy decides by how much
+    static constexpr std::size_t field_alignment   = Policy::field_alignment;
+    static constexpr std::size_t prefetch_distance = Policy::prefetch_distance;
+
+    alignas(field_alignment) atomic_node m_head; // nikgub: newest node
+    // nikgub: shares the line with m_head, which producers own anyway
+    std::atomic<std::uint32_t> m_waiting{0};
+    alignas(field_alignment) atomic_node m_tail; // nikgub: oldest node
+    std::uint32_t m_spin_budget = min_spin;      // nikgub: consumer only
+    waiter m_waiter; // nikgub: read by producers only once they own the wake
+    alignas(field_alignment) node_allocator
         m_node_alloc; // nikgub: alloc instance to support stateful allocators
+    node_pool m_pool; // nikgub: where nodes come from and go back to
+    detail::node_reserve<node> m_reserve; // nikgub: tried before m_pool
+    [[no_unique_address]] stats_recorder m_stats;
+    [[no_unique_address]] notifier_handle m_notifier;
+    [[no_unique_address]] capacity_gate m_gate;
+    [[no_unique_address]] tracer m_tracer; // nikgub: written by the consumer
+
+    // nikgub: bits of m_waiting
+    static constexpr std::uint32_t consumer_parked  = 1;
+    static constexpr std::uint32_t stop_requested   = 2;
+    static constexpr std::uint32_t coroutine_parked = 4;
+    static constexpr std::uint32_t notify_armed     = 8;
+    static constexpr std::uint32_t queue_closed     = 16;
+    // nikgub: the rest counts coroutine suspensions, see suspend_consumer
+    static constexpr std::uint32_t suspension_step = 32;
+    static constexpr std::uint32_t suspension_mask = ~(suspension_step - 1);
+
+    static constexpr std::uint32_t min_spin = 16;
+    static constexpr std::uint32_t max_spin = 4096;
 
   private:
     /**
@@ -182,19 +911,472 @@ class mpsc_queue
      * @note possible contentions in prev_head segment but does not break until
      * a miracle happens.
      *
-     * @param value forwarding reference
+     * @param args forwarding references to the constructor arguments
+     */
+    template <typename... Args>
+    bool push_impl (Args &&...args)
+    {
+        if (!admit(1))
+        {
+            return false;
+        }
+        return push_admitted(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Implementation of try_push, push_impl without waiting.
+     */
+    template <typename... Args>
+    bool try_push_impl (Args &&...args)
+    {
+        if (is_closed() || !m_gate.try_admit(1))
+        {
+            return false;
+        }
+        return push_admitted(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Asks the capacity gate for room for n elements.
+     *
+     * @returns false if closed before or while waiting
+     */
+    bool admit (std::size_t n)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        return m_gate.admit(n, [this] { return closed_now(); });
+    }
+
+    /**
+     * @brief is_closed() with a seq_cst load.
+     *
+     * Pairs with the fetch_or in close(), a producer about to sleep in the
+     * capacity gate either sees the bit or gets woken by close().
+     */
+    bool closed_now () const noexcept
+    {
+        return m_waiting.load(std::memory_order_seq_cst) & queue_closed;
+    }
+
+    /**
+     * @brief Builds and links one node that was admitted already.
+     */
+    template <typename... Args>
+    bool push_admitted (Args &&...args)
+    {
+        pointer new_node;
+        if constexpr (capacity_policy::enabled)
+        {
+            try
+            {
+                new_node = make_node(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                m_gate.cancel(1);
+                throw;
+            }
+        }
+        else
+        {
+            new_node = make_node(std::forward<Args>(args)...);
+        }
+        m_stats.on_push(1);
+        link_chain(new_node, new_node);
+        return true;
+    }
+
+    /**
+     * @brief Destroys a private chain that never got linked.
+     */
+    void discard_chain (pointer chain_head) noexcept
+    {
+        while (chain_head != nullptr)
+        {
+            pointer next = chain_head->next.load(std::memory_order_relaxed);
+            std::destroy_at(std::addressof(chain_head->data));
+            destroy_node(chain_head);
+            chain_head = next;
+        }
+    }
+
+    /**
+     * @brief Gets an empty node, from the reserve if it has one left.
+     */
+    pointer create_node ()
+    {
+        if (void *block = m_reserve.acquire())
+        {
+            auto *n = static_cast<pointer>(block);
+            node_allocator_traits::construct(m_node_alloc, n, nullptr);
+            return n;
+        }
+        return m_pool.create(m_node_alloc, nullptr);
+    }
+
+    /**
+     * @brief Destroys an empty node, giving it back to where it came from.
+     */
+    void destroy_node (pointer p)
+    {
+        if (m_reserve.owns(p))
+        {
+            node_allocator_traits::destroy(m_node_alloc, p);
+            m_reserve.release(p);
+            return;
+        }
+        m_pool.destroy(m_node_alloc, p);
+    }
+
+    /**
+     * @brief Creates an unlinked node and constructs its value in place.
+     *
+     * @param args forwarding references to the constructor arguments
+     */
+    template <typename... Args>
+    pointer make_node (Args &&...args)
+    {
+        pointer new_node = create_node();
+        try
+        {
+            std::construct_at(std::addressof(new_node->data),
+                              std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            destroy_node(new_node);
+            throw;
+        }
+        m_tracer.on_push(new_node->trace_stamp);
+        return new_node;
+    }
+
+    /**
+     * @brief Splices a privately built chain [first, last] in.
+     *
+     * The whole chain costs one exchange on m_head, inner links may be
+     * relaxed since the final release store publishes them.
+     *
+     * @param first oldest node of the chain
+     * @param last newest node of the chain, its next must be null
+     */
+    void link_chain (pointer first, pointer last)
+    {
+        // nikgub: contested but fine, bench/stress hammers it under TSan,
+        //         weaken nothing in orders without running it and the
+        //         model checks
+        pointer prev_head = m_head.exchange(last, orders::link_exchange);
+        prev_head->next.store(first, orders::link_publish);
+        // nikgub: seq_cst pairs with the fetch_or in wait_impl, the exchange
+        //         is an RMW anyway so this costs nothing extra on x86
+        const std::uint32_t state = m_waiting.load(orders::wake_check);
+        if (state & consumer_parked)
+        {
+            wake_consumer();
+        }
+        else if (state & coroutine_parked)
+        {
+            resume_consumer();
+        }
+        if constexpr (notifier_policy::enabled)
+        {
+            if (state & notify_armed)
+            {
+                notify_consumer();
+            }
+        }
+    }
+
+    /**
+     * @brief Wakes the parked consumer, once per park.
      */
-    void push_impl (T &&value)
+    void wake_consumer ()
     {
-        pointer new_node = node_allocator_traits::allocate(m_node_alloc, 1);
-        node_allocator_traits::construct(m_node_alloc, new_node, nullptr,
-                                         std::forward<T>(value));
-        // nikgub: contested but fine
-        // TODO: find a test where it fails
-        pointer prev_head =
-            m_head.exchange(new_node, std::memory_order_acq_rel);
-        prev_head->next.store(new_node, std::memory_order_release);
+        const std::uint32_t state =
+            m_waiting.fetch_and(~consumer_parked, orders::wake_claim);
+        if (state & consumer_parked)
+        {
+            detail::unpark_one(m_waiting);
+        }
+    }
+
+    /**
+     * @brief Fires the notifier, once per rearm().
+     */
+    void notify_consumer () noexcept
+    {
+        const std::uint32_t state =
+            m_waiting.fetch_and(~notify_armed, orders::wake_claim);
+        if (state & notify_armed)
+        {
+            m_notifier.notify();
+        }
+    }
+
+    /**
+     * @brief Checks whether the queue is closed and nothing accepted is
+     * left, consumer only.
+     *
+     * A push that swapped m_head but has not linked yet still counts as
+     * queued, its element is about to land. Only a push that raced close()
+     * itself and swaps m_head after this returns can still arrive.
+     */
+    bool closed_and_drained () const noexcept
+    {
+        return is_closed() && m_head.load(std::memory_order_acquire) ==
+                                  m_tail.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Resumes the suspended consumer coroutine, once per suspension.
+     *
+     * The waiter is copied out first, the coroutine may suspend again and
+     * overwrite it before resume returns.
+     */
+    void resume_consumer ()
+    {
+        const std::uint32_t state =
+            m_waiting.fetch_and(~coroutine_parked, orders::wake_claim);
+        if (state & coroutine_parked)
+        {
+            const waiter w = m_waiter;
+            w.resume(w.context, w.handle);
+        }
+    }
+
+    /**
+     * @brief Registers a consumer coroutine, the await_suspend of next().
+     *
+     * Same handshake as wait_impl: announce, then re-check m_head. If a push
+     * is in flight the registration is taken back, unless its producer got
+     * to it first and is about to resume us. Every registration bumps a
+     * counter in m_waiting, so taking it back cannot hit the registration
+     * of a later await that the resumed coroutine already started.
+     *
+     * @param w coroutine to resume
+     * @returns false if the coroutine must not suspend
+     */
+    bool suspend_consumer (waiter w)
+    {
+        m_waiter         = w;
+        pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+        // nikgub: seq_cst pairs with the load in link_chain, the RMW also
+        //         publishes m_waiter to whoever clears the bit
+        const std::uint32_t mine =
+            m_waiting.fetch_add(suspension_step + coroutine_parked,
+                                orders::park_announce) +
+            suspension_step + coroutine_parked;
+        if (!(mine & queue_closed) &&
+            m_head.load(orders::park_recheck) == tail_ptr)
+        {
+            return true;
+        }
+        // nikgub: no touching m_waiter from here on, it may be resumed
+        std::uint32_t state = mine;
+        while (!m_waiting.compare_exchange_weak(state,
+                                                state & ~coroutine_parked,
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_relaxed))
+        {
+            if (!(state & coroutine_parked) ||
+                (state & suspension_mask) != (mine & suspension_mask))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Makes the consumer leave wait_impl, called on stop requests.
+     */
+    void interrupt_wait ()
+    {
+        const std::uint32_t state =
+            m_waiting.fetch_or(stop_requested, std::memory_order_acq_rel);
+        if (state & consumer_parked)
+        {
+            detail::unpark_one(m_waiting);
+        }
+    }
+
+    /**
+     * @brief Common part of the blocking pulls.
+     *
+     * Spins on the tail's link first, the budget grows when spinning pays
+     * off and shrinks when we end up parking. The empty poll is counted
+     * and the capacity gate told the queue is idle once, right before
+     * parking. Before parking the consumer announces
+     * itself in m_waiting and re-checks m_head, a producer that swapped
+     * m_head earlier is then guaranteed to be seen, a later one is
+     * guaranteed to see the announcement.
+     *
+     * @param park callable that sleeps while m_waiting holds its argument,
+     * returns false to give up
+     */
+    template <typename Park>
+    std::optional<T> wait_impl (Park &&park)
+    {
+        while (true)
+        {
+            pointer tail_ptr = m_tail.load(std::memory_order_relaxed);
+            // nikgub: spin on the link alone, pull() would count an empty
+            //         poll and poke the gate on every round
+            for (std::uint32_t spin = 0; spin < m_spin_budget; ++spin)
+            {
+                if (tail_ptr->next.load(orders::pull_next) != nullptr)
+                {
+                    m_spin_budget = std::min(m_spin_budget * 2, max_spin);
+                    return pull();
+                }
+                detail::cpu_relax();
+            }
+            const std::uint32_t state =
+                m_waiting.fetch_or(consumer_parked, orders::park_announce);
+            const bool in_flight =
+                m_head.load(orders::park_recheck) != tail_ptr;
+            if ((state & (stop_requested | queue_closed)) || in_flight)
+            {
+                // nikgub: stopped, closed, or a push is in flight and about
+                //         to land, which closing does not cancel
+                m_waiting.fetch_and(~consumer_parked,
+                                    std::memory_order_relaxed);
+                if ((state & stop_requested) ||
+                    ((state & queue_closed) && !in_flight))
+                {
+                    return pull();
+                }
+                continue;
+            }
+            m_spin_budget = std::max(m_spin_budget / 2, min_spin);
+            // nikgub: once per park, not once per spin
+            m_stats.on_empty_poll();
+            m_gate.on_idle();
+            const bool waiting = park(state | consumer_parked);
+            m_waiting.fetch_and(~consumer_parked, std::memory_order_relaxed);
+            if (!waiting)
+            {
+                return pull();
+            }
+        }
+    }
+
+    /**
+     * @brief Shared walk of consume_all and drain.
+     *
+     * Stops after max elements or once stop was consumed. A null stop means
+     * stopping at the first missing link, otherwise missing links before
+     * stop belong to pushes in flight and are waited for.
+     */
+    template <typename F>
+    std::size_t consume_until (F &func, std::size_t max, pointer stop)
+    {
+        pointer tail_ptr  = m_tail.load(std::memory_order_relaxed);
+        pointer last      = tail_ptr;
+        pointer ahead     = tail_ptr; // nikgub: furthest node prefetched
+        std::size_t lead  = 0;        // nikgub: nodes from last to ahead
+        std::size_t count = 0;
+        while (count < max && last != stop)
+        {
+            pointer next = last->next.load(orders::pull_next);
+            if (next == nullptr)
+            {
+                if (stop == nullptr)
+                {
+                    break;
+                }
+                // nikgub: exchanged before our snapshot, about to land
+                detail::cpu_relax();
+                continue;
+            }
+            if constexpr (prefetch_distance != 0)
+            {
+                // nikgub: one new node per element in steady state, its line
+                //         was hinted prefetch_distance elements ago
+                while (lead <= prefetch_distance)
+                {
+                    pointer further =
+                        ahead->next.load(orders::pull_next);
+                    if (further == nullptr)
+                    {
+                        break;
+                    }
+                    ahead = further;
+                    ++lead;
+                    detail::prefetch<sizeof(node)>(further);
+                }
+                --lead;
+            }
+            m_tracer.on_pull(next->trace_stamp);
+            try
+            {
+                func(std::move(next->data));
+            }
+            catch (...)
+            {
+                std::destroy_at(std::addressof(next->data));
+                m_stats.on_pull(count + 1);
+                m_gate.on_pull(count + 1);
+                retire_range(tail_ptr, next);
+                throw;
+            }
+            std::destroy_at(std::addressof(next->data));
+            last = next;
+            ++count;
+        }
+        if (count == 0)
+        {
+            m_stats.on_empty_poll();
+            m_gate.on_idle();
+        }
+        else
+        {
+            m_stats.on_pull(count);
+            m_gate.on_pull(count);
+        }
+        retire_range(tail_ptr, last);
+        return count;
+    }
+
+
+    /**
+     * @brief Publishes last as the new tail and frees [first, last).
+     *
+     * Consumer only, first must be the current tail.
+     */
+    void retire_range (pointer first, pointer last)
+    {
+        if (first == last)
+        {
+            return;
+        }
+        m_tail.store(last, std::memory_order_release);
+        while (first != last)
+        {
+            // nikgub: already acquired while walking, relaxed is enough
+            pointer next = first->next.load(std::memory_order_relaxed);
+            destroy_node(first);
+            first = next;
+        }
     }
 };
 
+namespace pmr
+{
+
+/**
+ * @brief mpsc_queue using a polymorphic allocator.
+ *
+ * Construct it with the memory resource to draw nodes from, e.g.
+ * ngg::pmr::node_slab_resource.
+ */
+template <types::queue_element T, types::queue_policy Policy = policy::defaults>
+using mpsc_queue =
+    ngg::mpsc_queue<T, std::pmr::polymorphic_allocator<T>, Policy>;
+
+} // namespace pmr
+
 } // namespace ngg
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+
+namespace ngg::detail
+{
+
+/**
+ * @brief Stamp of nodes that are not traced.
+ */
+struct no_stamp
+{
+};
+
+/**
+ * @brief Singly linked node shared by the linked queues.
+ *
+ * Provides storage for the inner data but does not manage its lifetime,
+ * the queue constructs it on push and destroys it on pull. The sentinel
+ * never holds a live value.
+ *
+ * @tparam T type of inner data
+ * @tparam Hook per-node bookkeeping of the node pool policy
+ * @tparam Stamp per-node data of the tracing policy
+ */
+template <typename T, typename Hook, typename Stamp = no_stamp>
+struct list_node
+{
+    /**
+     * @brief Argument constructor.
+     *
+     * Sets the next pointer, leaves the inner data uninitialized.
+     */
+    explicit list_node (list_node *next) : next(next)
+    {
+    }
+
+    list_node () : next(nullptr)
+    {
+    }
+
+    // nikgub: data is not ours to destroy
+    ~list_node ()
+    {
+    }
+
+    std::atomic<list_node *> next;
+    [[no_unique_address]] Hook pool_hook;
+    [[no_unique_address]] Stamp trace_stamp;
+    union
+    {
+        T data;
+    };
+};
+
+} // namespace ngg::detail
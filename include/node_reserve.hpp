@@ -0,0 +1,186 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "pages.hpp"
+#include "thread_registry.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace ngg::detail
+{
+
+/**
+ * @brief Pre-faulted slab of node blocks a queue takes nodes from first.
+ *
+ * One contiguous mapping, huge-page backed if possible, faulted in when
+ * reserved so that neither the first pushes nor a latency spike later pay
+ * for page faults. Producers carve it in batches into a private list and
+ * refill that list by taking the whole shared return stack with a single
+ * exchange, which is why the stack has no ABA even with several poppers.
+ * Blocks are recognised by address when freed and pushed back there.
+ *
+ * Once every block is in flight or cached by another producer, acquire()
+ * returns nullptr and the queue falls back to its node pool. That costs
+ * two loads of mostly read-shared lines per push.
+ *
+ * @tparam Node node type, the size of a block
+ */
+template <typename Node>
+class node_reserve
+{
+    // nikgub: overlays the storage of a free block
+    struct free_block
+    {
+        free_block *next;
+    };
+
+    struct cache
+    {
+        free_block *local = nullptr; // nikgub: touched by the owner only
+    };
+
+    static constexpr std::size_t block_size =
+        std::max(sizeof(Node), sizeof(free_block));
+    static constexpr std::size_t carve_batch = 64;
+
+  public:
+    node_reserve () = default;
+
+    node_reserve (const node_reserve &)            = delete;
+    node_reserve &operator= (const node_reserve &) = delete;
+
+    ~node_reserve ()
+    {
+        if (m_begin != nullptr)
+        {
+            unmap_pages(m_begin, m_bytes, m_alignment);
+        }
+    }
+
+    /**
+     * @brief Maps and faults in room for at least count blocks.
+     *
+     * Only the first call with a non-zero count maps anything. Must not
+     * race with anything, acquire() and release() included.
+     *
+     * @param count amount of blocks wanted
+     * @param huge_pages whether to ask for huge pages
+     * @returns amount of blocks reserved, possibly more than count
+     */
+    std::size_t map (std::size_t count, bool huge_pages)
+    {
+        if (m_begin != nullptr || count == 0)
+        {
+            return m_count;
+        }
+        const std::size_t wanted = count * block_size;
+        // nikgub: a huge alignment is what makes map_pages try MAP_HUGETLB
+        const bool huge = huge_pages && wanted >= huge_page_size;
+        m_alignment     = huge ? huge_page_size : base_page_size;
+        m_bytes         = (wanted + m_alignment - 1) & ~(m_alignment - 1);
+        void *mapped    = map_pages(m_bytes, m_alignment, huge_pages);
+        prefault_pages(mapped, m_bytes);
+        m_begin = static_cast<std::byte *>(mapped);
+        m_end   = m_begin + m_bytes;
+        m_count = m_bytes / block_size;
+        return m_count;
+    }
+
+    /**
+     * @brief Total amount of blocks, zero if nothing was reserved.
+     */
+    std::size_t capacity () const noexcept
+    {
+        return m_count;
+    }
+
+    /**
+     * @brief Checks whether p is a block of this reserve.
+     */
+    bool owns (const void *p) const noexcept
+    {
+        const auto *b = static_cast<const std::byte *>(p);
+        return b >= m_begin && b < m_end;
+    }
+
+    /**
+     * @brief Takes a free block, any thread.
+     *
+     * @returns uninitialised storage for a Node, nullptr if none is left
+     */
+    void *acquire () noexcept
+    {
+        if (m_count == 0)
+        {
+            return nullptr;
+        }
+        cache &c = m_caches.local();
+        if (c.local == nullptr && !refill(c))
+        {
+            return nullptr;
+        }
+        free_block *block = c.local;
+        c.local           = block->next;
+        return block;
+    }
+
+    /**
+     * @brief Gives a block back, any thread.
+     *
+     * @param p block obtained from acquire(), its Node already destroyed
+     */
+    void release (void *p) noexcept
+    {
+        free_block *block = ::new (p) free_block{};
+        block->next       = m_returned.load(std::memory_order_relaxed);
+        // nikgub: release pairs with the acquire exchange in refill()
+        while (!m_returned.compare_exchange_weak(block->next, block,
+                                                 std::memory_order_release,
+                                                 std::memory_order_relaxed))
+        {
+        }
+    }
+
+  private:
+    bool refill (cache &c) noexcept
+    {
+        // nikgub: plain loads first, an exhausted reserve must stay cheap
+        if (m_returned.load(std::memory_order_relaxed) != nullptr)
+        {
+            c.local = m_returned.exchange(nullptr, std::memory_order_acquire);
+            if (c.local != nullptr)
+            {
+                return true;
+            }
+        }
+        if (m_cursor.load(std::memory_order_relaxed) >= m_count)
+        {
+            return false;
+        }
+        const std::size_t first =
+            m_cursor.fetch_add(carve_batch, std::memory_order_relaxed);
+        if (first >= m_count)
+        {
+            return false;
+        }
+        const std::size_t last = std::min(first + carve_batch, m_count);
+        for (std::size_t i = last; i-- > first;)
+        {
+            c.local = ::new (m_begin + i * block_size) free_block{c.local};
+        }
+        return true;
+    }
+
+    std::byte *m_begin      = nullptr;
+    std::byte *m_end        = nullptr;
+    std::size_t m_bytes     = 0;
+    std::size_t m_alignment = 0;
+    std::size_t m_count     = 0;
+    thread_registry<cache> m_caches;
+    alignas(cache_line_size) std::atomic<std::size_t> m_cursor{0};
+    alignas(cache_line_size) std::atomic<free_block *> m_returned{nullptr};
+};
+
+} // namespace ngg::detail
@@ -0,0 +1,340 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "pages.hpp"
+#include "thread_registry.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+
+namespace ngg
+{
+
+namespace detail
+{
+
+/**
+ * @brief Fixed-size chunk arena carved out of huge-page backed slabs.
+ *
+ * Every thread that allocates owns a cache with a private free list, a
+ * bump range in its current slab and a return stack. Slabs are aligned to
+ * their size and start with a header naming the owning cache, so any
+ * thread can find where a chunk belongs by masking its address. Freeing
+ * on the owner thread goes to the private list, freeing elsewhere pushes
+ * onto the owner's return stack, which the owner takes over with a single
+ * exchange. That makes allocate-on-producer/free-on-consumer safe without
+ * ABA.
+ *
+ * Caches outlive their threads like every thread_registry slot, chunks
+ * returned to a thread that is gone wait there for the next thread with
+ * the same id. Slabs are unmapped when the arena is destroyed.
+ */
+class slab_arena
+{
+  public:
+    /**
+     * @brief Constructs an arena, no memory is mapped yet.
+     *
+     * @param chunk_size size of every chunk, rounded up to alignment
+     * @param alignment power of two, at least cache_line_size by default
+     * @param slab_size size and alignment of a slab, a power of two
+     */
+    explicit slab_arena (std::size_t chunk_size,
+                         std::size_t alignment = cache_line_size,
+                         std::size_t slab_size = huge_page_size)
+        : m_alignment(std::max(alignment, alignof(free_chunk))),
+          m_chunk_size(round_up(std::max(chunk_size, sizeof(free_chunk)),
+                                m_alignment)),
+          m_slab_size(slab_size),
+          m_first_offset(round_up(sizeof(slab_header), m_alignment))
+    {
+    }
+
+    slab_arena (const slab_arena &)            = delete;
+    slab_arena &operator= (const slab_arena &) = delete;
+
+    ~slab_arena ()
+    {
+        slab_header *s = m_slabs.load(std::memory_order_acquire);
+        while (s != nullptr)
+        {
+            slab_header *next = s->next;
+            unmap_pages(s, m_slab_size, m_slab_size);
+            s = next;
+        }
+    }
+
+    /**
+     * @brief Hands out one chunk, throws std::bad_alloc if out of memory.
+     */
+    void *allocate ()
+    {
+        cache &c = m_caches.local();
+        if (c.local == nullptr)
+        {
+            // nikgub: acquire pairs with the release in deallocate()
+            c.local = c.returned.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (c.local != nullptr)
+        {
+            free_chunk *chunk = c.local;
+            c.local           = chunk->next;
+            return chunk;
+        }
+        if (c.cursor == c.limit)
+        {
+            refill(c);
+        }
+        void *chunk = c.cursor;
+        c.cursor += m_chunk_size;
+        return chunk;
+    }
+
+    /**
+     * @brief Takes a chunk back, safe to call from any thread.
+     */
+    void deallocate (void *p) noexcept
+    {
+        const auto base = reinterpret_cast<std::uintptr_t>(p) &
+                          ~(static_cast<std::uintptr_t>(m_slab_size) - 1);
+        cache *owner      = reinterpret_cast<slab_header *>(base)->owner;
+        free_chunk *chunk = ::new (p) free_chunk{};
+        if (owner == &m_caches.local())
+        {
+            chunk->next  = owner->local;
+            owner->local = chunk;
+            return;
+        }
+        chunk->next = owner->returned.load(std::memory_order_relaxed);
+        while (!owner->returned.compare_exchange_weak(
+            chunk->next, chunk, std::memory_order_release,
+            std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @brief Size of every chunk after rounding.
+     */
+    std::size_t chunk_size () const noexcept
+    {
+        return m_chunk_size;
+    }
+
+  private:
+    struct free_chunk
+    {
+        free_chunk *next;
+    };
+
+    struct cache
+    {
+        free_chunk *local  = nullptr; // nikgub: owner only
+        std::byte *cursor = nullptr; // nikgub: bump range in the last slab
+        std::byte *limit  = nullptr;
+        alignas(cache_line_size) std::atomic<free_chunk *> returned{nullptr};
+    };
+
+    struct slab_header
+    {
+        cache *owner;
+        slab_header *next;
+    };
+
+    static constexpr std::size_t round_up (std::size_t n,
+                                           std::size_t alignment) noexcept
+    {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    void refill (cache &c)
+    {
+        void *mapped        = map_pages(m_slab_size, m_slab_size);
+        slab_header *header = ::new (mapped) slab_header{&c, nullptr};
+        header->next        = m_slabs.load(std::memory_order_relaxed);
+        while (!m_slabs.compare_exchange_weak(header->next, header,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed))
+        {
+        }
+        auto *begin = static_cast<std::byte *>(mapped);
+        c.cursor    = begin + m_first_offset;
+        c.limit     = c.cursor + (m_slab_size - m_first_offset) /
+                                     m_chunk_size * m_chunk_size;
+    }
+
+    const std::size_t m_alignment;
+    const std::size_t m_chunk_size;
+    const std::size_t m_slab_size;
+    const std::size_t m_first_offset;
+    thread_registry<cache> m_caches;
+    std::atomic<slab_header *> m_slabs{nullptr};
+};
+
+/**
+ * @brief Process-wide arena for one chunk geometry.
+ *
+ * Leaked on purpose so that queues with static storage duration can still
+ * free into it during static destruction.
+ */
+template <std::size_t ChunkSize, std::size_t Alignment>
+slab_arena &shared_arena ()
+{
+    static slab_arena *arena = new slab_arena(ChunkSize, Alignment);
+    return *arena;
+}
+
+} // namespace detail
+
+/**
+ * @brief Allocator of fixed-size, cache-aligned chunks from shared slabs.
+ *
+ * Meant for the nodes of the queues: the queue rebinds it to its node type
+ * and every single-object allocation is then served from a process-wide
+ * slab_arena sized for that node, so nodes never share a cacheline and a
+ * producer's nodes are carved out of its own slabs. Chunks may be freed on
+ * any thread. Array allocations and types too large for a slab fall back
+ * to the global operator new.
+ *
+ * @tparam T type of the allocated objects
+ */
+template <typename T>
+class node_slab_allocator
+{
+  public:
+    using value_type                             = T;
+    using is_always_equal                        = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    static constexpr std::size_t alignment =
+        std::max(alignof(T), cache_line_size);
+
+    // nikgub: sizeof(T) is a multiple of alignof(T), so this keeps alignment
+    static constexpr std::size_t chunk_size =
+        (sizeof(T) + alignment - 1) / alignment * alignment;
+
+    node_slab_allocator () noexcept = default;
+
+    template <typename U>
+    node_slab_allocator (const node_slab_allocator<U> &) noexcept
+    {
+    }
+
+    T *allocate (std::size_t n)
+    {
+        if (n == 1 && slab_backed)
+        {
+            return static_cast<T *>(arena().allocate());
+        }
+        return static_cast<T *>(
+            ::operator new(n * sizeof(T), std::align_val_t{alignof(T)}));
+    }
+
+    void deallocate (T *p, std::size_t n) noexcept
+    {
+        if (n == 1 && slab_backed)
+        {
+            arena().deallocate(p);
+            return;
+        }
+        ::operator delete(p, std::align_val_t{alignof(T)});
+    }
+
+    template <typename U>
+    friend bool operator== (const node_slab_allocator &,
+                            const node_slab_allocator<U> &) noexcept
+    {
+        return true;
+    }
+
+  private:
+    // nikgub: an eighth of a slab keeps the header and tail waste small
+    static constexpr bool slab_backed =
+        chunk_size <= detail::huge_page_size / 8;
+
+    static detail::slab_arena &arena ()
+    {
+        return detail::shared_arena<chunk_size, alignment>();
+    }
+};
+
+namespace pmr
+{
+
+/**
+ * @brief Memory resource serving small blocks from slab arenas.
+ *
+ * Requests of up to max_block bytes with at most cache_line_size alignment
+ * are rounded up to whole cachelines and served from one slab_arena per
+ * size class, everything else goes to the upstream resource. Unlike
+ * node_slab_allocator the arenas are owned by the resource, so all memory
+ * is released with it.
+ */
+class node_slab_resource : public std::pmr::memory_resource
+{
+  public:
+    static constexpr std::size_t classes   = 8;
+    static constexpr std::size_t max_block = classes * cache_line_size;
+
+    explicit node_slab_resource (
+        std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+        : m_upstream(upstream)
+    {
+        for (std::size_t i = 0; i < classes; ++i)
+        {
+            m_arenas[i] =
+                std::make_unique<detail::slab_arena>((i + 1) * cache_line_size);
+        }
+    }
+
+    std::pmr::memory_resource *upstream_resource () const noexcept
+    {
+        return m_upstream;
+    }
+
+  protected:
+    void *do_allocate (std::size_t bytes, std::size_t alignment) override
+    {
+        if (bytes == 0 || bytes > max_block || alignment > cache_line_size)
+        {
+            return m_upstream->allocate(bytes, alignment);
+        }
+        return m_arenas[size_class(bytes)]->allocate();
+    }
+
+    void do_deallocate (void *p, std::size_t bytes,
+                        std::size_t alignment) override
+    {
+        if (bytes == 0 || bytes > max_block || alignment > cache_line_size)
+        {
+            m_upstream->deallocate(p, bytes, alignment);
+            return;
+        }
+        m_arenas[size_class(bytes)]->deallocate(p);
+    }
+
+    bool do_is_equal (
+        const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+  private:
+    static std::size_t size_class (std::size_t bytes) noexcept
+    {
+        return (bytes - 1) / cache_line_size;
+    }
+
+    std::pmr::memory_resource *m_upstream;
+    std::array<std::unique_ptr<detail::slab_arena>, classes> m_arenas;
+};
+
+} // namespace pmr
+
+} // namespace ngg
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ngg::policy
+{
+
+/**
+ * @brief Notifier policy without a pollable handle.
+ */
+struct no_notifier
+{
+    static constexpr bool enabled = false;
+
+    class handle
+    {
+      public:
+        void notify () noexcept
+        {
+        }
+
+        void reset () noexcept
+        {
+        }
+    };
+};
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Notifier policy owning a non-blocking eventfd.
+ *
+ * The queue writes to it when a push lands on an armed, empty queue, so
+ * the descriptor becomes readable once per burst and can be watched with
+ * epoll, poll or io_uring next to sockets. Where eventfd is missing a
+ * non-blocking pipe is used instead, native_handle() is then its read end.
+ */
+struct eventfd_notifier
+{
+    static constexpr bool enabled = true;
+
+    class handle
+    {
+      public:
+        handle ()
+        {
+#if defined(__linux__)
+            m_read = m_write = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_read < 0)
+            {
+                throw std::system_error(errno, std::system_category(),
+                                        "eventfd");
+            }
+#else
+            int fds[2];
+            if (::pipe(fds) != 0)
+            {
+                throw std::system_error(errno, std::system_category(), "pipe");
+            }
+            for (int fd : fds)
+            {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            m_read  = fds[0];
+            m_write = fds[1];
+#endif
+        }
+
+        handle (const handle &)            = delete;
+        handle &operator= (const handle &) = delete;
+
+        ~handle ()
+        {
+            ::close(m_read);
+            if (m_write != m_read)
+            {
+                ::close(m_write);
+            }
+        }
+
+        /**
+         * @brief Makes the descriptor readable, any thread.
+         */
+        void notify () noexcept
+        {
+            const std::uint64_t one = 1;
+            // nikgub: EAGAIN means it is readable already, which is the point
+            [[maybe_unused]] auto written =
+                ::write(m_write, &one, m_write == m_read ? sizeof(one) : 1);
+        }
+
+        /**
+         * @brief Consumes pending notifications, consumer only.
+         */
+        void reset () noexcept
+        {
+            std::uint64_t buffer[8];
+            while (::read(m_read, buffer, m_write == m_read ? sizeof(buffer[0])
+                                                            : sizeof(buffer)) >
+                   0)
+            {
+                if (m_write == m_read) // nikgub: eventfd resets in one read
+                {
+                    break;
+                }
+            }
+        }
+
+        /**
+         * @brief Descriptor to watch for readability.
+         */
+        int native_handle () const noexcept
+        {
+            return m_read;
+        }
+
+      private:
+        int m_read  = -1;
+        int m_write = -1;
+    };
+};
+#endif
+
+} // namespace ngg::policy
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ngg::detail
+{
+
+/**
+ * @brief Amount of NUMA nodes of the machine, 1 if unknown.
+ *
+ * Parses /sys/devices/system/node/online, a list of ranges such as
+ * "0-1" or "0,2-3", and returns the highest node id plus one so that the
+ * result can index by node id even with holes in the list.
+ */
+inline std::size_t numa_node_count () noexcept
+{
+#if defined(__linux__)
+    std::FILE *file = std::fopen("/sys/devices/system/node/online", "r");
+    if (file == nullptr)
+    {
+        return 1;
+    }
+    std::size_t highest = 0;
+    unsigned long value = 0;
+    // nikgub: separators are ',' and '-', both only move us forward
+    while (std::fscanf(file, "%lu", &value) == 1)
+    {
+        if (value > highest)
+        {
+            highest = value;
+        }
+        if (std::fgetc(file) == EOF)
+        {
+            break;
+        }
+    }
+    std::fclose(file);
+    return highest + 1;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * @brief NUMA node the calling thread runs on, 0 if unknown.
+ *
+ * Asks the kernel once per thread and caches the answer, so a thread that
+ * migrates across sockets keeps reporting its first node. Pin producers
+ * if that matters, the queues stay correct either way.
+ */
+inline std::size_t current_numa_node () noexcept
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    thread_local const std::size_t node = []
+    {
+        unsigned cpu = 0;
+        unsigned id  = 0;
+        if (::syscall(SYS_getcpu, &cpu, &id, nullptr) != 0)
+        {
+            return std::size_t{0};
+        }
+        return static_cast<std::size_t>(id);
+    }();
+    return node;
+#else
+    return 0;
+#endif
+}
+
+} // namespace ngg::detail
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "mpsc_queue.hpp"
+#include "numa.hpp"
+#include "policy.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace ngg
+{
+
+/**
+ * @brief multiple producers/single consumer queue split by NUMA node
+ *
+ * Holds one mpsc_queue per NUMA node. A producer pushes into the sub-queue
+ * of the node it runs on, so the head it exchanges on is shared only with
+ * producers of the same socket. With the default policy::pooled, nodes
+ * are allocated and first touched by the producing thread and return to
+ * its cache once consumed, which keeps element memory local to the
+ * producer's socket.
+ *
+ * The consumer visits its own node's sub-queue first and then every remote
+ * one, taking up to local_batch and remote_batch elements per visit, and
+ * goes round again while there is work. Remote lines are pulled across the
+ * interconnect in bursts rather than one per element, and a busy local
+ * producer delays remote elements by one local batch at most.
+ * Elements of one producer keep their order, there is no order between
+ * sub-queues.
+ *
+ * @tparam T type of inner data
+ * @tparam Allocator allocator type, used for inner nodes
+ * @tparam Policy policy bundle of the sub-queues
+ */
+template <types::queue_element T,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::pooled>
+class numa_mpsc_queue
+{
+  protected:
+    using queue_type = mpsc_queue<T, Allocator, Policy>;
+
+  public:
+    /**
+     * @brief Constructs one sub-queue per NUMA node.
+     *
+     * @param nodes amount of sub-queues, the detected node count by default
+     */
+    explicit numa_mpsc_queue (std::size_t nodes = detail::numa_node_count())
+        : m_count(std::max<std::size_t>(nodes, 1)),
+          m_queues(std::make_unique<queue_type[]>(m_count))
+    {
+    }
+
+    numa_mpsc_queue (const numa_mpsc_queue &)            = delete;
+    numa_mpsc_queue &operator= (const numa_mpsc_queue &) = delete;
+
+    /**
+     * @brief Copies and pushes a value to the sub-queue of the caller.
+     *
+     * @param value value being copied
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (const T &value)
+    {
+        return local().push(value);
+    }
+
+    /**
+     * @brief Pushes an rvalue to the sub-queue of the caller.
+     *
+     * @param value value being forwarded
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (T &&value)
+    {
+        return local().push(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place in the sub-queue of the caller.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace (Args &&...args)
+    {
+        return local().emplace(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Pops one element, local sub-queue first.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        std::optional<T> result;
+        consume_all([&result] (T &&value) { result.emplace(std::move(value)); },
+                    1);
+        return result;
+    }
+
+    /**
+     * @brief Pops up to max elements into an output iterator.
+     *
+     * @param out iterator the values are moved into
+     * @param max maximal amount of elements to pop
+     * @returns amount of elements popped
+     */
+    template <std::output_iterator<T> OutputIt>
+    std::size_t pull_bulk (OutputIt out, std::size_t max)
+    {
+        return consume_all([&out] (T &&value) { *out++ = std::move(value); },
+                           max);
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable.
+     *
+     * Takes up to local_batch elements from the local sub-queue, then up to
+     * remote_batch from every remote one, and repeats until max or until a
+     * round finds nothing.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        const std::size_t home = detail::current_numa_node() % m_count;
+        std::size_t count      = 0;
+        while (count < max)
+        {
+            const std::size_t before = count;
+            count += m_queues[home].consume_all(
+                func, std::min(max - count, local_batch));
+            for (std::size_t i = 1; i < m_count && count < max; ++i)
+            {
+                queue_type &remote = m_queues[(home + i) % m_count];
+                count += remote.consume_all(
+                    func, std::min(max - count, remote_batch));
+            }
+            if (count == before)
+            {
+                break;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * @brief Clears all the elements in the queue.
+     *
+     * Consumer only.
+     */
+    void clear ()
+    {
+        for (std::size_t i = 0; i < m_count; ++i)
+        {
+            m_queues[i].clear();
+        }
+    }
+
+    /**
+     * @brief Closes every sub-queue, see mpsc_queue::close().
+     */
+    void close () noexcept
+    {
+        for (std::size_t i = 0; i < m_count; ++i)
+        {
+            m_queues[i].close();
+        }
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        // nikgub: close() starts with the first one
+        return m_queues[0].is_closed();
+    }
+
+    /**
+     * @brief Amount of sub-queues.
+     */
+    std::size_t nodes () const noexcept
+    {
+        return m_count;
+    }
+
+    // nikgub: local elements taken per visit, bounds how long a steady
+    //         local producer can hold the remote sub-queues back
+    static constexpr std::size_t local_batch = 1024;
+    // nikgub: remote elements taken per visit, large enough to amortize the
+    //         cross-socket misses on the sub-queue's head and tail
+    static constexpr std::size_t remote_batch = 1024;
+
+  private:
+    queue_type &local ()
+    {
+        return m_queues[detail::current_numa_node() % m_count];
+    }
+
+    std::size_t m_count;
+    std::unique_ptr<queue_type[]> m_queues;
+};
+
+} // namespace ngg
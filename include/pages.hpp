@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#else
+#include <cstring>
+#endif
+
+namespace ngg::detail
+{
+
+// nikgub: what the kernel hands out on x86-64 and most aarch64 configs
+inline constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+// nikgub: smallest page in use anywhere we care about, a safe touch stride
+inline constexpr std::size_t base_page_size = std::size_t{4} << 10;
+
+/**
+ * @brief Maps bytes of zeroed memory aligned to alignment.
+ *
+ * Tries explicit huge pages first when the size allows it, then falls back
+ * to an over-sized regular mapping trimmed to the alignment and advised
+ * for transparent huge pages. Without mmap this is aligned operator new.
+ *
+ * @param bytes size of the mapping, a multiple of alignment
+ * @param alignment power of two, at least the page size
+ * @param huge_pages whether huge pages are asked for at all
+ * @returns start of the mapping, throws std::bad_alloc on failure
+ */
+inline void *map_pages (std::size_t bytes, std::size_t alignment,
+                        [[maybe_unused]] bool huge_pages = true)
+{
+#if defined(__linux__)
+#if defined(MAP_HUGETLB)
+    if (huge_pages && alignment % huge_page_size == 0)
+    {
+        // nikgub: huge pages are naturally aligned to their size
+        void *huge = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED)
+        {
+            return huge;
+        }
+    }
+#endif
+    const std::size_t padded = bytes + alignment;
+    void *raw = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    const auto begin   = reinterpret_cast<std::uintptr_t>(raw);
+    const auto aligned = (begin + alignment - 1) & ~(alignment - 1);
+    if (aligned != begin)
+    {
+        ::munmap(raw, aligned - begin);
+    }
+    const std::uintptr_t tail = aligned + bytes;
+    ::munmap(reinterpret_cast<void *>(tail), begin + padded - tail);
+#if defined(MADV_HUGEPAGE)
+    if (huge_pages)
+    {
+        ::madvise(reinterpret_cast<void *>(aligned), bytes, MADV_HUGEPAGE);
+    }
+#endif
+    return reinterpret_cast<void *>(aligned);
+#else
+    void *p = ::operator new(bytes, std::align_val_t{alignment});
+    return std::memset(p, 0, bytes);
+#endif
+}
+
+/**
+ * @brief Faults in every page of [p, p + bytes) up front.
+ *
+ * Writes one byte per base page, so the page faults, and the zeroing of
+ * the kernel, happen here rather than on the first use of the memory. The
+ * memory must be zeroed already, as map_pages returns it.
+ */
+inline void prefault_pages (void *p, std::size_t bytes) noexcept
+{
+    auto *first = static_cast<volatile unsigned char *>(p);
+    for (std::size_t offset = 0; offset < bytes; offset += base_page_size)
+    {
+        first[offset] = 0;
+    }
+}
+
+/**
+ * @brief Releases a mapping obtained from map_pages.
+ */
+inline void unmap_pages (void *p, std::size_t bytes,
+                         [[maybe_unused]] std::size_t alignment) noexcept
+{
+#if defined(__linux__)
+    ::munmap(p, bytes);
+#else
+    ::operator delete(p, std::align_val_t{alignment});
+#endif
+}
+
+} // namespace ngg::detail
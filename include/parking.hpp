@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ngg::detail
+{
+
+/**
+ * @brief Hints the CPU that we are in a spin loop.
+ */
+inline void cpu_relax () noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+#if defined(__linux__)
+// nikgub: the futex syscall wants a plain int, std::atomic must be one
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+inline long futex (std::atomic<std::uint32_t> &word, int op,
+                   std::uint32_t value, const timespec *timeout) noexcept
+{
+    return ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), op,
+                     value, timeout, nullptr, 0);
+}
+#endif
+
+/**
+ * @brief Blocks while word holds expected.
+ *
+ * May return spuriously, callers re-check their condition.
+ *
+ * @param word futex word
+ * @param expected value to sleep on
+ */
+inline void park (std::atomic<std::uint32_t> &word,
+                  std::uint32_t expected) noexcept
+{
+#if defined(__linux__)
+    futex(word, FUTEX_WAIT_PRIVATE, expected, nullptr);
+#else
+    word.wait(expected, std::memory_order_acquire);
+#endif
+}
+
+/**
+ * @brief Blocks while word holds expected, at most for timeout.
+ *
+ * May return spuriously or early, callers re-check their condition.
+ * Without futexes this degrades to short sleeps.
+ *
+ * @param word futex word
+ * @param expected value to sleep on
+ * @param timeout maximal time to sleep
+ */
+template <typename Rep, typename Period>
+void park_for (std::atomic<std::uint32_t> &word, std::uint32_t expected,
+               const std::chrono::duration<Rep, Period> &timeout) noexcept
+{
+    const auto nanos =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+    if (nanos.count() <= 0)
+    {
+        return;
+    }
+#if defined(__linux__)
+    timespec ts{};
+    ts.tv_sec  = static_cast<std::time_t>(nanos.count() / 1'000'000'000);
+    ts.tv_nsec = static_cast<long>(nanos.count() % 1'000'000'000);
+    futex(word, FUTEX_WAIT_PRIVATE, expected, &ts);
+#else
+    if (word.load(std::memory_order_acquire) == expected)
+    {
+        std::this_thread::sleep_for(
+            std::min(nanos, std::chrono::nanoseconds(50'000)));
+    }
+#endif
+}
+
+/**
+ * @brief Wakes one thread blocked in park() or park_for() on word.
+ *
+ * @param word futex word
+ */
+inline void unpark_one (std::atomic<std::uint32_t> &word) noexcept
+{
+#if defined(__linux__)
+    futex(word, FUTEX_WAKE_PRIVATE, 1, nullptr);
+#else
+    word.notify_one();
+#endif
+}
+
+/**
+ * @brief Wakes every thread blocked in park() or park_for() on word.
+ *
+ * @param word futex word
+ */
+inline void unpark_all (std::atomic<std::uint32_t> &word) noexcept
+{
+#if defined(__linux__)
+    futex(word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+#else
+    word.notify_all();
+#endif
+}
+
+} // namespace ngg::detail
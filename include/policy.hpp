@@ -0,0 +1,320 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "capacity.hpp"
+#include "notifier.hpp"
+#include "reclaim.hpp"
+#include "stats.hpp"
+#include "thread_registry.hpp"
+#include "tracing.hpp"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace ngg::policy
+{
+
+/**
+ * @brief Node pool that goes straight to the allocator.
+ *
+ * Every node is allocated on push and deallocated on pull, this is the
+ * original behaviour of the queue.
+ */
+struct heap_nodes
+{
+    /**
+     * @brief Per-node bookkeeping, none is needed here.
+     */
+    struct hook
+    {
+    };
+
+    template <typename Node, typename NodeAllocator>
+    class pool
+    {
+        using traits = std::allocator_traits<NodeAllocator>;
+
+      public:
+        /**
+         * @brief Allocates and constructs a node.
+         */
+        template <typename... Args>
+        Node *create (NodeAllocator &alloc, Args &&...args)
+        {
+            Node *n = traits::allocate(alloc, 1);
+            try
+            {
+                traits::construct(alloc, n, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                traits::deallocate(alloc, n, 1);
+                throw;
+            }
+            return n;
+        }
+
+        /**
+         * @brief Destroys and deallocates a node.
+         */
+        void destroy (NodeAllocator &alloc, Node *n)
+        {
+            traits::destroy(alloc, n);
+            traits::deallocate(alloc, n, 1);
+        }
+
+        /**
+         * @brief Releases cached memory, nothing is cached.
+         */
+        void purge (NodeAllocator &)
+        {
+        }
+    };
+};
+
+/**
+ * @brief Node pool that recycles retired nodes back to their producers.
+ *
+ * Each thread that creates nodes gets a private cache. Nodes remember the
+ * cache they were made by, and destroy() pushes them onto that cache's
+ * return stack. The owner takes the whole stack with a single exchange when
+ * its private list runs dry, so the stack has a single popper and no ABA.
+ * The allocator is only touched while the pool is warming up, memory is
+ * handed back to it by purge().
+ */
+struct pooled_nodes
+{
+    /**
+     * @brief Per-node bookkeeping, the cache the node belongs to.
+     */
+    struct hook
+    {
+        void *owner = nullptr;
+    };
+
+    template <typename Node, typename NodeAllocator>
+    class pool
+    {
+        using traits = std::allocator_traits<NodeAllocator>;
+
+        // nikgub: overlays the storage of a dead node
+        struct free_node
+        {
+            free_node *next;
+        };
+
+        static_assert(sizeof(Node) >= sizeof(free_node),
+                      "node is too small to be recycled");
+
+        struct cache
+        {
+            free_node *local = nullptr; // nikgub: touched by the owner only
+            std::atomic<free_node *> returned{nullptr}; // nikgub: from anyone
+        };
+
+      public:
+        /**
+         * @brief Constructs a node, reusing a cached block if possible.
+         */
+        template <typename... Args>
+        Node *create (NodeAllocator &alloc, Args &&...args)
+        {
+            cache &c         = m_caches.local();
+            free_node *block = c.local;
+            if (block == nullptr)
+            {
+                // nikgub: acquire pairs with the release in destroy()
+                block = c.returned.exchange(nullptr, std::memory_order_acquire);
+            }
+            Node *n;
+            if (block != nullptr)
+            {
+                c.local = block->next;
+                n       = reinterpret_cast<Node *>(block);
+            }
+            else
+            {
+                n = traits::allocate(alloc, 1);
+            }
+            try
+            {
+                traits::construct(alloc, n, std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                c.local = ::new (static_cast<void *>(n)) free_node{c.local};
+                throw;
+            }
+            n->pool_hook.owner = &c;
+            return n;
+        }
+
+        /**
+         * @brief Destroys a node and returns its block to the owning cache.
+         *
+         * Safe to call from any thread.
+         */
+        void destroy (NodeAllocator &alloc, Node *n)
+        {
+            cache *owner = static_cast<cache *>(n->pool_hook.owner);
+            traits::destroy(alloc, n);
+            free_node *block = ::new (static_cast<void *>(n)) free_node{};
+            block->next      = owner->returned.load(std::memory_order_relaxed);
+            while (!owner->returned.compare_exchange_weak(
+                block->next, block, std::memory_order_release,
+                std::memory_order_relaxed))
+            {
+            }
+        }
+
+        /**
+         * @brief Hands every cached block back to the allocator.
+         *
+         * Must not race with create() or destroy().
+         */
+        void purge (NodeAllocator &alloc)
+        {
+            for (cache &c : m_caches)
+            {
+                release_chain(alloc, c.local);
+                release_chain(alloc, c.returned.exchange(
+                                         nullptr, std::memory_order_acquire));
+                c.local = nullptr;
+            }
+        }
+
+      private:
+        static void release_chain (NodeAllocator &alloc, free_node *block)
+        {
+            while (block != nullptr)
+            {
+                free_node *next = block->next;
+                traits::deallocate(alloc, reinterpret_cast<Node *>(block), 1);
+                block = next;
+            }
+        }
+
+        thread_registry<cache> m_caches;
+    };
+};
+
+/**
+ * @brief Default queue policy.
+ *
+ * Policies are customised by deriving from this struct and shadowing the
+ * members that should change.
+ */
+struct defaults
+{
+    using node_pool = heap_nodes;
+    using stats     = no_stats;
+    using notifier  = no_notifier;
+    using reclaim   = ngg::reclaim::immediate; // nikgub: mpmc_queue only
+    using capacity  = unbounded;
+    using tracing   = no_tracing;
+
+    /**
+     * @brief Alignment of fields that are written by different threads.
+     */
+    static constexpr std::size_t field_alignment = cache_line_size;
+
+    /**
+     * @brief Nodes the batch consumers prefetch ahead of the current one.
+     *
+     * 0 disables prefetching.
+     */
+    static constexpr std::size_t prefetch_distance = 2;
+};
+
+/**
+ * @brief Policy that recycles nodes instead of freeing them.
+ */
+struct pooled : defaults
+{
+    using node_pool = pooled_nodes;
+};
+
+/**
+ * @brief Policy that counts traffic, see counting_stats.
+ */
+struct instrumented : defaults
+{
+    using stats = counting_stats;
+};
+
+/**
+ * @brief Policy that makes approx_size() available, see depth_stats.
+ */
+struct sized : defaults
+{
+    using stats = depth_stats;
+};
+
+/**
+ * @brief Policy that retires nodes to epoch-based reclamation.
+ *
+ * Read by mpmc_queue, where a pull appends the old sentinel to a
+ * thread-local list and nodes are freed in batches two epochs later.
+ * mpsc_queue ignores it, its single consumer frees nodes on the spot.
+ */
+struct epoch_reclaimed : defaults
+{
+    using reclaim = ngg::reclaim::epoch;
+};
+
+/**
+ * @brief Policy that retires nodes to hazard pointers.
+ *
+ * What mpmc_queue uses by default, mpsc_queue ignores it.
+ */
+struct hazard_reclaimed : defaults
+{
+    using reclaim = ngg::reclaim::hazard_pointers<>;
+};
+
+/**
+ * @brief Policy that turns producers away past Limit elements.
+ *
+ * push() waits for room, try_push() fails right away, see soft_capacity.
+ *
+ * @tparam Limit soft bound on the depth
+ * @tparam Wait wait strategy of blocking pushes
+ */
+template <std::size_t Limit, typename Wait = park_wait>
+struct capped : defaults
+{
+    using capacity = soft_capacity<Limit, 64, Wait>;
+};
+
+/**
+ * @brief Policy that samples queueing delay, see sampled_tracing.
+ */
+struct traced : defaults
+{
+    using tracing = sampled_tracing<>;
+};
+
+/**
+ * @brief Policy that keeps hot fields two cachelines apart.
+ *
+ * Covers parts with 128-byte destructive interference and Intel's
+ * adjacent-line prefetcher, which pulls cachelines in pairs.
+ */
+struct padded : defaults
+{
+    static constexpr std::size_t field_alignment = 2 * cache_line_size;
+};
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Policy with a pollable descriptor, see eventfd_notifier.
+ */
+struct notified : defaults
+{
+    using notifier = eventfd_notifier;
+};
+#endif
+
+} // namespace ngg::policy
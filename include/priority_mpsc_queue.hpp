@@ -0,0 +1,290 @@
+#pragma once
+
+#include "mpsc_queue.hpp"
+#include "policy.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace ngg
+{
+
+namespace policy
+{
+
+/**
+ * @brief Drain order that always serves the highest non-empty level.
+ *
+ * After every Batch elements the consumer looks at the higher levels
+ * again, so a high-priority element waits for at most Batch elements of
+ * lower levels. Lower levels starve while higher ones are busy.
+ *
+ * @tparam Batch elements taken from a level before rescanning
+ */
+template <std::size_t Batch = 1>
+    requires(Batch > 0)
+struct strict_priority
+{
+    static constexpr bool weighted     = false;
+    static constexpr std::size_t batch = Batch;
+};
+
+/**
+ * @brief Drain order that visits levels in turn with per-level quotas.
+ *
+ * Level i gives up to Quotas[i] elements per round, so every level makes
+ * progress and a high-priority element waits for at most one round worth
+ * of the other levels' quotas.
+ *
+ * @tparam Quotas elements per round for every level, highest first
+ */
+template <std::size_t... Quotas>
+    requires(sizeof...(Quotas) > 0 && ((Quotas > 0) && ...))
+struct weighted_priority
+{
+    static constexpr bool weighted = true;
+    static constexpr std::array<std::size_t, sizeof...(Quotas)> quotas{
+        Quotas...};
+};
+
+} // namespace policy
+
+/**
+ * @brief multiple producers/single consumer queue with priority levels
+ *
+ * Holds one mpsc_queue per level, level 0 being the highest. A push goes
+ * to the lane of its level and costs the same single exchange as a push
+ * to mpsc_queue, all the policy lives on the consumer side. Elements of
+ * one producer and level keep their order, there is no order across
+ * levels beyond what Drain decides.
+ *
+ * @tparam T type of inner data
+ * @tparam Levels amount of priority levels
+ * @tparam Drain policy::strict_priority or policy::weighted_priority
+ * @tparam Allocator allocator type, used for inner nodes
+ * @tparam Policy policy bundle of the lanes
+ */
+template <types::queue_element T, std::size_t Levels,
+          typename Drain = policy::strict_priority<>,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::defaults>
+    requires(Levels > 0)
+class priority_mpsc_queue
+{
+  protected:
+    using lane_type = mpsc_queue<T, Allocator, Policy>;
+
+  public:
+    priority_mpsc_queue () = default;
+
+    priority_mpsc_queue (const priority_mpsc_queue &)            = delete;
+    priority_mpsc_queue &operator= (const priority_mpsc_queue &) = delete;
+
+    /**
+     * @brief Copies and pushes a value at a level.
+     *
+     * Levels past the lowest one are clamped to it.
+     *
+     * @param level priority level, 0 is the highest
+     * @param value value being copied
+     * @returns false if the queue is closed
+     */
+    bool push (std::size_t level, const T &value)
+    {
+        return lane(level).push(value);
+    }
+
+    /**
+     * @brief Pushes an rvalue at a level.
+     *
+     * @param level priority level, 0 is the highest
+     * @param value value being forwarded
+     * @returns false if the queue is closed
+     */
+    bool push (std::size_t level, T &&value)
+    {
+        return lane(level).push(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place at a level.
+     *
+     * @param level priority level, 0 is the highest
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is closed
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace (std::size_t level, Args &&...args)
+    {
+        return lane(level).emplace(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Pops the element Drain picks next.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        std::optional<T> result;
+        consume_all([&result] (T &&value) { result.emplace(std::move(value)); },
+                    1);
+        return result;
+    }
+
+    /**
+     * @brief Pops up to max elements into an output iterator.
+     *
+     * @param out iterator the values are moved into
+     * @param max maximal amount of elements to pop
+     * @returns amount of elements popped
+     */
+    template <std::output_iterator<T> OutputIt>
+    std::size_t pull_bulk (OutputIt out, std::size_t max)
+    {
+        return consume_all([&out] (T &&value) { *out++ = std::move(value); },
+                           max);
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable in Drain order.
+     *
+     * Stops once every level is empty.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        if constexpr (Drain::weighted)
+        {
+            return consume_weighted(func, max);
+        }
+        else
+        {
+            return consume_strict(func, max);
+        }
+    }
+
+    /**
+     * @brief Clears all the elements in the queue.
+     *
+     * Consumer only.
+     */
+    void clear ()
+    {
+        for (lane_type &l : m_lanes)
+        {
+            l.clear();
+        }
+    }
+
+    /**
+     * @brief Rejects all pushes from now on, at every level.
+     */
+    void close () noexcept
+    {
+        for (lane_type &l : m_lanes)
+        {
+            l.close();
+        }
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        // nikgub: close() starts with the first level
+        return m_lanes[0].is_closed();
+    }
+
+    /**
+     * @brief Amount of priority levels.
+     */
+    static constexpr std::size_t levels () noexcept
+    {
+        return Levels;
+    }
+
+  private:
+    std::array<lane_type, Levels> m_lanes;
+    // nikgub: weighted round state, consumer only
+    std::size_t m_level  = Levels - 1;
+    std::size_t m_credit = 0;
+
+  private:
+    lane_type &lane (std::size_t level) noexcept
+    {
+        return m_lanes[std::min(level, Levels - 1)];
+    }
+
+    template <typename F>
+    std::size_t consume_strict (F &func, std::size_t max)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            std::size_t taken = 0;
+            for (lane_type &l : m_lanes)
+            {
+                taken =
+                    l.consume_all(func, std::min(max - count, Drain::batch));
+                if (taken != 0)
+                {
+                    break; // nikgub: rescan from the top
+                }
+            }
+            if (taken == 0)
+            {
+                break;
+            }
+            count += taken;
+        }
+        return count;
+    }
+
+    template <typename F>
+    std::size_t consume_weighted (F &func, std::size_t max)
+    {
+        static_assert(Drain::quotas.size() == Levels,
+                      "weighted_priority needs one quota per level");
+        std::size_t count = 0;
+        std::size_t idle  = 0; // nikgub: levels in a row that had nothing
+        while (count < max && idle < Levels)
+        {
+            if (m_credit == 0)
+            {
+                m_level  = (m_level + 1) % Levels;
+                m_credit = Drain::quotas[m_level];
+            }
+            const std::size_t taken =
+                m_lanes[m_level].consume_all(func,
+                                             std::min(max - count, m_credit));
+            count += taken;
+            if (taken == 0)
+            {
+                ++idle;
+                m_credit = 0;
+            }
+            else
+            {
+                idle = 0;
+                m_credit -= taken;
+            }
+        }
+        return count;
+    }
+};
+
+} // namespace ngg
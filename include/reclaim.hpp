@@ -0,0 +1,460 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "thread_registry.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ngg::reclaim
+{
+
+/**
+ * @brief Reclamation domain that frees retired nodes on the spot.
+ *
+ * Only sound when nobody but the retiring thread can still hold the node,
+ * which no multi-consumer structure can promise, so mpmc_queue swaps it
+ * for hazard pointers.
+ *
+ * @tparam Node type of the retired nodes
+ */
+template <typename Node>
+class immediate_domain
+{
+  public:
+    /**
+     * @brief Guard that protects nothing.
+     */
+    class guard
+    {
+      public:
+        Node *protect (std::size_t, const std::atomic<Node *> &source)
+            const noexcept
+        {
+            return source.load(std::memory_order_acquire);
+        }
+
+        void set (std::size_t, Node *) const noexcept
+        {
+        }
+    };
+
+    guard pin () const noexcept
+    {
+        return guard();
+    }
+
+    template <typename Free>
+    void retire (Node *p, Free &&free)
+    {
+        free(p);
+    }
+
+    template <typename Free>
+    void release (Free &&) noexcept
+    {
+    }
+};
+
+/**
+ * @brief Hazard pointers owned by a single data structure.
+ *
+ * A reader publishes the nodes it is about to dereference in one of the
+ * Slots hazards of its thread, through a guard. Unlinked nodes are
+ * retired to a private per-thread list instead of being freed, and once
+ * the list grows past a threshold it is scanned against every published
+ * hazard: nodes nobody protects are handed to the free callable, the rest
+ * wait for the next scan. The threshold doubles with the amount of nodes
+ * that survive, so the cost of a scan is amortized over the retirements.
+ *
+ * @tparam Node type of the protected nodes
+ * @tparam Slots hazards per thread
+ */
+template <typename Node, std::size_t Slots = 2>
+    requires(Slots > 0)
+class hazard_domain
+{
+  protected:
+    struct record
+    {
+        std::array<std::atomic<Node *>, Slots> hazards{};
+        // nikgub: the fields below are touched by the owner only
+        std::vector<Node *> retired;
+        std::vector<Node *> scratch;
+        std::size_t threshold = scan_batch;
+    };
+
+  public:
+    /**
+     * @brief Retired nodes a thread gathers before its first scan.
+     */
+    static constexpr std::size_t scan_batch = 64;
+
+    /**
+     * @brief Hazards of the calling thread, cleared on destruction.
+     */
+    class guard
+    {
+      public:
+        explicit guard (record &r) noexcept : m_record(&r)
+        {
+        }
+
+        guard (const guard &)            = delete;
+        guard &operator= (const guard &) = delete;
+
+        ~guard ()
+        {
+            for (std::atomic<Node *> &h : m_record->hazards)
+            {
+                h.store(nullptr, std::memory_order_release);
+            }
+        }
+
+        /**
+         * @brief Loads source and keeps the node it points to alive.
+         *
+         * Retries until the published hazard matches a fresh load, so the
+         * node cannot have been retired in between.
+         *
+         * @param slot hazard to publish in
+         * @param source pointer to protect
+         * @returns the protected node
+         */
+        Node *protect (std::size_t slot, const std::atomic<Node *> &source)
+            noexcept
+        {
+            Node *p = source.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                m_record->hazards[slot].store(p, std::memory_order_seq_cst);
+                Node *q = source.load(std::memory_order_seq_cst);
+                if (q == p)
+                {
+                    return p;
+                }
+                p = q;
+            }
+        }
+
+        /**
+         * @brief Publishes a node without validation.
+         *
+         * The caller validates on its own, e.g. with a CAS on the source.
+         */
+        void set (std::size_t slot, Node *p) noexcept
+        {
+            m_record->hazards[slot].store(p, std::memory_order_seq_cst);
+        }
+
+      private:
+        record *m_record;
+    };
+
+    hazard_domain () = default;
+
+    hazard_domain (const hazard_domain &)            = delete;
+    hazard_domain &operator= (const hazard_domain &) = delete;
+
+    /**
+     * @brief Returns the guard of the calling thread.
+     *
+     * At most one guard per thread may be alive at a time.
+     */
+    guard pin ()
+    {
+        return guard(m_records.local());
+    }
+
+    /**
+     * @brief Queues an unlinked node to be freed once unprotected.
+     *
+     * @param p node that is no longer reachable from the structure
+     * @param free callable invoked as free(Node*) for every safe node
+     */
+    template <typename Free>
+    void retire (Node *p, Free &&free)
+    {
+        record &r = m_records.local();
+        r.retired.push_back(p);
+        if (r.retired.size() >= r.threshold)
+        {
+            scan(r, free);
+        }
+    }
+
+    /**
+     * @brief Frees every retired node of every thread.
+     *
+     * Must not race with anything, meant for the owner's destructor.
+     *
+     * @param free callable invoked as free(Node*)
+     */
+    template <typename Free>
+    void release (Free &&free)
+    {
+        for (record &r : m_records)
+        {
+            for (Node *p : r.retired)
+            {
+                free(p);
+            }
+            r.retired.clear();
+        }
+    }
+
+  private:
+    template <typename Free>
+    void scan (record &r, Free &free)
+    {
+        // nikgub: pairs with the seq_cst stores in protect() and set()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        r.scratch.clear();
+        for (record &other : m_records)
+        {
+            for (const std::atomic<Node *> &h : other.hazards)
+            {
+                if (Node *p = h.load(std::memory_order_acquire))
+                {
+                    r.scratch.push_back(p);
+                }
+            }
+        }
+        std::sort(r.scratch.begin(), r.scratch.end());
+        auto protected_by_someone = [&r] (Node *p)
+        { return std::binary_search(r.scratch.begin(), r.scratch.end(), p); };
+        auto kept = std::partition(r.retired.begin(), r.retired.end(),
+                                   protected_by_someone);
+        for (auto it = kept; it != r.retired.end(); ++it)
+        {
+            free(*it);
+        }
+        r.retired.erase(kept, r.retired.end());
+        r.threshold = std::max(scan_batch, 2 * r.retired.size());
+    }
+
+    thread_registry<record> m_records;
+};
+
+/**
+ * @brief Epoch-based reclamation owned by a single data structure.
+ *
+ * Readers announce the global epoch while pinned, which costs a store and
+ * no per-pointer work. Retired nodes are appended to a per-thread list
+ * tagged with the epoch they were retired in. Every collect_batch
+ * retirements the thread tries to advance the epoch, which succeeds once
+ * every pinned thread has announced the current one, and frees the nodes
+ * retired two epochs ago or earlier: nobody can still be inside a section
+ * that saw them. A thread that stays pinned stalls reclamation for all.
+ *
+ * @tparam Node type of the retired nodes
+ */
+template <typename Node>
+class epoch_domain
+{
+  protected:
+    static constexpr std::uint64_t active = 1;
+    static constexpr std::uint64_t step   = 2;
+
+    struct retired_node
+    {
+        std::uint64_t epoch;
+        Node *node;
+    };
+
+    struct record
+    {
+        // nikgub: epoch | active while pinned, 0 otherwise
+        std::atomic<std::uint64_t> announced{0};
+        // nikgub: the fields below are touched by the owner only
+        std::uint32_t depth = 0;
+        std::vector<retired_node> retired;
+        std::size_t threshold = collect_batch;
+    };
+
+  public:
+    /**
+     * @brief Retirements between two collection attempts, at least.
+     */
+    static constexpr std::size_t collect_batch = 64;
+
+    /**
+     * @brief Critical section of the calling thread, guards may nest.
+     */
+    class guard
+    {
+      public:
+        guard (record &r, const std::atomic<std::uint64_t> &epoch) noexcept
+            : m_record(&r)
+        {
+            if (r.depth++ == 0)
+            {
+                // nikgub: seq_cst orders it before the loads that follow
+                r.announced.store(epoch.load(std::memory_order_relaxed) |
+                                      active,
+                                  std::memory_order_seq_cst);
+            }
+        }
+
+        guard (const guard &)            = delete;
+        guard &operator= (const guard &) = delete;
+
+        ~guard ()
+        {
+            if (--m_record->depth == 0)
+            {
+                m_record->announced.store(0, std::memory_order_release);
+            }
+        }
+
+        Node *protect (std::size_t, const std::atomic<Node *> &source)
+            const noexcept
+        {
+            return source.load(std::memory_order_seq_cst);
+        }
+
+        void set (std::size_t, Node *) const noexcept
+        {
+        }
+
+      private:
+        record *m_record;
+    };
+
+    epoch_domain () = default;
+
+    epoch_domain (const epoch_domain &)            = delete;
+    epoch_domain &operator= (const epoch_domain &) = delete;
+
+    /**
+     * @brief Enters a critical section on the calling thread.
+     */
+    guard pin ()
+    {
+        return guard(m_records.local(), m_epoch);
+    }
+
+    /**
+     * @brief Queues an unlinked node to be freed two epochs later.
+     *
+     * @param p node that is no longer reachable from the structure
+     * @param free callable invoked as free(Node*) for every safe node
+     */
+    template <typename Free>
+    void retire (Node *p, Free &&free)
+    {
+        record &r = m_records.local();
+        r.retired.push_back({m_epoch.load(std::memory_order_seq_cst), p});
+        if (r.retired.size() >= r.threshold)
+        {
+            collect(r, free);
+        }
+    }
+
+    /**
+     * @brief Frees every retired node of every thread.
+     *
+     * Must not race with anything, meant for the owner's destructor.
+     *
+     * @param free callable invoked as free(Node*)
+     */
+    template <typename Free>
+    void release (Free &&free)
+    {
+        for (record &r : m_records)
+        {
+            for (const retired_node &n : r.retired)
+            {
+                free(n.node);
+            }
+            r.retired.clear();
+        }
+    }
+
+  private:
+    /**
+     * @brief Advances the epoch if every pinned thread has caught up.
+     */
+    void try_advance () noexcept
+    {
+        std::uint64_t current = m_epoch.load(std::memory_order_seq_cst);
+        for (const record &other : m_records)
+        {
+            const std::uint64_t announced =
+                other.announced.load(std::memory_order_seq_cst);
+            if ((announced & active) != 0 && (announced & ~active) != current)
+            {
+                return;
+            }
+        }
+        m_epoch.compare_exchange_strong(current, current + step,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed);
+    }
+
+    template <typename Free>
+    void collect (record &r, Free &free)
+    {
+        try_advance();
+        const std::uint64_t current = m_epoch.load(std::memory_order_seq_cst);
+        // nikgub: the list is sorted by epoch, it is appended in order
+        auto safe = r.retired.begin();
+        while (safe != r.retired.end() && safe->epoch + 2 * step <= current)
+        {
+            free(safe->node);
+            ++safe;
+        }
+        r.retired.erase(r.retired.begin(), safe);
+        r.threshold = std::max(collect_batch, 2 * r.retired.size());
+    }
+
+    alignas(cache_line_size) std::atomic<std::uint64_t> m_epoch{step};
+    thread_registry<record> m_records;
+};
+
+/**
+ * @brief Reclamation policy that frees nodes as soon as they are retired.
+ */
+struct immediate
+{
+    static constexpr bool deferred = false;
+
+    template <typename Node>
+    using domain = immediate_domain<Node>;
+};
+
+/**
+ * @brief Reclamation policy backed by hazard_domain.
+ *
+ * Bounds the amount of unreclaimed nodes even with stalled readers, at
+ * the price of a validated store per protected pointer.
+ *
+ * @tparam Slots hazards per thread, mpmc_queue needs two
+ */
+template <std::size_t Slots = 2>
+struct hazard_pointers
+{
+    static constexpr bool deferred = true;
+
+    template <typename Node>
+    using domain = hazard_domain<Node, Slots>;
+};
+
+/**
+ * @brief Reclamation policy backed by epoch_domain.
+ *
+ * Cheapest for readers, one store per critical section.
+ */
+struct epoch
+{
+    static constexpr bool deferred = true;
+
+    template <typename Node>
+    using domain = epoch_domain<Node>;
+};
+
+} // namespace ngg::reclaim
@@ -0,0 +1,526 @@
+#pragma once
+
+#include "policy.hpp"
+#include "thread_registry.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ngg
+{
+
+/**
+ * @brief multiple producers/single consumer queue over unrolled blocks
+ *
+ * Every heap block holds BlockSize slots. Producers claim a slot with a
+ * fetch-add on the block they see as the current one and a new block is linked
+ * in only when the current one fills, so there is one allocation per
+ * BlockSize elements. The single consumer walks a block slot by slot.
+ *
+ * A producer may still hold a block that the consumer is done with, so
+ * every producer publishes the block it works on in a per-thread hazard
+ * slot and the consumer defers freeing blocks that are still announced.
+ * Announcing is only needed when the current block changes, which is once
+ * per block and not once per push.
+ *
+ * @tparam T type of inner data
+ * @tparam BlockSize amount of slots per block
+ * @tparam Allocator allocator type, used for blocks
+ * @tparam Policy policy bundle, see policy::defaults
+ */
+template <types::queue_element T, std::size_t BlockSize = 32,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::defaults>
+    requires(BlockSize > 0)
+class segmented_mpsc_queue
+{
+  protected:
+    struct block;
+    using value_type       = T;
+    using pointer          = block *;
+    using allocator_traits = typename std::allocator_traits<Allocator>;
+    using block_allocator  = allocator_traits::template rebind_alloc<block>;
+    using block_allocator_traits =
+        typename std::allocator_traits<block_allocator>;
+
+  public:
+    /**
+     * @brief Constructs the queue.
+     *
+     * Allocates the first block.
+     */
+    segmented_mpsc_queue () : m_block_alloc()
+    {
+        pointer first = make_block();
+        // nikgub: relaxed memory since we do not contest anything yet
+        m_tail_block.store(first, std::memory_order_relaxed);
+        m_head_block = first;
+    }
+
+    segmented_mpsc_queue (const segmented_mpsc_queue &)            = delete;
+    segmented_mpsc_queue &operator= (const segmented_mpsc_queue &) = delete;
+
+    /**
+     * @brief Destroys the queue and every element left in it.
+     */
+    ~segmented_mpsc_queue ()
+    {
+        clear();
+        while (m_head_block != nullptr)
+        {
+            pointer next = m_head_block->next.load(std::memory_order_relaxed);
+            destroy_block(m_head_block);
+            m_head_block = next;
+        }
+        while (m_retired != nullptr)
+        {
+            pointer next = m_retired->retired_next;
+            destroy_block(m_retired);
+            m_retired = next;
+        }
+    }
+
+    /**
+     * @brief Copies and pushes a value to the queue.
+     *
+     * @param value value being copied
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (const T &value)
+    {
+        return push_impl(value);
+    }
+
+    /**
+     * @brief Pushes an rvalue to the queue.
+     *
+     * @param value value being forwarded
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (T &&value)
+    {
+        return push_impl(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place at the end of the queue.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace (Args &&...args)
+    {
+        return push_impl(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Pops the first element from the queue.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        std::optional<T> result;
+        consume_all([&result] (T &&value) { result.emplace(std::move(value)); },
+                    1);
+        return result;
+    }
+
+    /**
+     * @brief Pops the first element into out.
+     *
+     * @param out assigned the value if there is one, untouched otherwise
+     * @returns false if the queue was empty
+     */
+    bool try_pull (T &out)
+        requires std::is_nothrow_move_assignable_v<T>
+    {
+        return consume_all([&out] (T &&value) { out = std::move(value); },
+                           1) == 1;
+    }
+
+    /**
+     * @brief Pops up to max elements into an output iterator.
+     *
+     * For trivially copyable T and a contiguous destination, every run of
+     * ready slots in a block is copied with a single memcpy.
+     *
+     * @param out iterator the values are moved into
+     * @param max maximal amount of elements to pop
+     * @returns amount of elements popped
+     */
+    template <std::output_iterator<T> OutputIt>
+    std::size_t pull_bulk (OutputIt out, std::size_t max)
+    {
+        if constexpr (std::is_trivially_copyable_v<T> &&
+                      std::contiguous_iterator<OutputIt>)
+        {
+            return copy_runs(std::to_address(out), max);
+        }
+        else
+        {
+            return consume_all([&out] (T &&value)
+                               { *out++ = std::move(value); },
+                               max);
+        }
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable.
+     *
+     * The callable receives an rvalue reference to the element inside its
+     * slot. Slots of a block are visited in order.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            if (m_head_index == BlockSize && !next_block())
+            {
+                break;
+            }
+            const std::uint8_t state = m_head_block->state[m_head_index].load(
+                std::memory_order_acquire);
+            if (state == slot_empty) // nikgub: claimed but not written yet
+            {
+                break;
+            }
+            T &value = m_head_block->data[m_head_index];
+            ++m_head_index;
+            if (state == slot_skipped)
+            {
+                continue;
+            }
+            try
+            {
+                func(std::move(value));
+            }
+            catch (...)
+            {
+                std::destroy_at(std::addressof(value));
+                throw;
+            }
+            std::destroy_at(std::addressof(value));
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Clears all the elements in the queue.
+     *
+     * Consumer only.
+     */
+    void clear ()
+    {
+        consume_all([] (T &&) {});
+    }
+
+    /**
+     * @brief Rejects all pushes from now on.
+     *
+     * Pushes that started before may still land, elements already queued
+     * stay and can be pulled. Safe from any thread, closing twice is fine.
+     */
+    void close () noexcept
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+  protected:
+    static constexpr std::size_t field_alignment = Policy::field_alignment;
+
+    // nikgub: values of block::state
+    static constexpr std::uint8_t slot_empty   = 0;
+    static constexpr std::uint8_t slot_ready   = 1;
+    static constexpr std::uint8_t slot_skipped = 2; // nikgub: ctor threw
+
+    /**
+     * @brief Heap block of BlockSize slots.
+     *
+     * Slot flags and values are kept in separate arrays so that the values
+     * of consecutive slots are contiguous.
+     */
+    struct alignas(field_alignment) block
+    {
+        block ()
+        {
+        }
+
+        // nikgub: data is not ours to destroy
+        ~block ()
+        {
+        }
+
+        alignas(field_alignment) std::atomic<std::size_t> claimed{0};
+        alignas(field_alignment) std::atomic<block *> next{nullptr};
+        block *retired_next = nullptr; // nikgub: consumer only
+        std::atomic<std::uint8_t> state[BlockSize]{};
+        union
+        {
+            T data[BlockSize];
+        };
+    };
+
+    /**
+     * @brief Per-producer state, the block the producer may touch.
+     */
+    struct producer
+    {
+        std::atomic<block *> hazard{nullptr};
+    };
+
+  private:
+    // nikgub: block the producers fill
+    alignas(field_alignment) std::atomic<pointer> m_tail_block;
+    std::atomic<bool> m_closed{false}; // nikgub: producers read it anyway
+    // nikgub: block the consumer drains, consumer only
+    alignas(field_alignment) pointer m_head_block = nullptr;
+    std::size_t m_head_index = 0;
+    pointer m_retired = nullptr; // nikgub: waiting for hazards to clear
+    alignas(field_alignment) block_allocator m_block_alloc;
+    thread_registry<producer> m_producers;
+
+  private:
+    /**
+     * @brief Moves the consumer to the block after a drained one.
+     *
+     * @returns false if producers have not linked one yet
+     */
+    bool next_block ()
+    {
+        pointer next = m_head_block->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+        retire_block(m_head_block, next);
+        m_head_block = next;
+        m_head_index = 0;
+        return true;
+    }
+
+    /**
+     * @brief pull_bulk for trivially copyable T, one memcpy per run.
+     *
+     * A run ends at the end of the block, at max or at a slot that is not
+     * ready, skipped slots are stepped over on their own.
+     */
+    std::size_t copy_runs (T *out, std::size_t max)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            if (m_head_index == BlockSize && !next_block())
+            {
+                break;
+            }
+            const std::size_t first = m_head_index;
+            const std::size_t limit =
+                first + std::min(BlockSize - first, max - count);
+            std::size_t last        = first;
+            std::uint8_t state      = slot_ready;
+            while (last < limit)
+            {
+                state = m_head_block->state[last].load(
+                    std::memory_order_acquire);
+                if (state != slot_ready)
+                {
+                    break;
+                }
+                ++last;
+            }
+            if (last != first)
+            {
+                std::memcpy(static_cast<void *>(out + count),
+                            std::addressof(m_head_block->data[first]),
+                            (last - first) * sizeof(T));
+                count += last - first;
+                m_head_index = last;
+            }
+            else if (state == slot_skipped)
+            {
+                ++m_head_index;
+            }
+            else
+            {
+                break; // nikgub: claimed but not written yet
+            }
+        }
+        return count;
+    }
+
+    /**
+     * @brief Implementation of push.
+     *
+     * @param args forwarding references to the constructor arguments
+     * @returns false if the queue is closed
+     */
+    template <typename... Args>
+    bool push_impl (Args &&...args)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        producer &self = m_producers.local();
+        while (true)
+        {
+            pointer current = m_tail_block.load(std::memory_order_acquire);
+            if (self.hazard.load(std::memory_order_relaxed) != current)
+            {
+                // nikgub: seq_cst pairs with the hazard scan in retire_block
+                self.hazard.store(current, std::memory_order_seq_cst);
+                if (m_tail_block.load(std::memory_order_seq_cst) != current)
+                {
+                    continue;
+                }
+            }
+            const std::size_t index =
+                current->claimed.fetch_add(1, std::memory_order_relaxed);
+            if (index >= BlockSize)
+            {
+                advance_tail(current);
+                continue;
+            }
+            try
+            {
+                std::construct_at(std::addressof(current->data[index]),
+                                  std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                current->state[index].store(slot_skipped,
+                                            std::memory_order_release);
+                throw;
+            }
+            current->state[index].store(slot_ready, std::memory_order_release);
+            if (index == BlockSize - 1)
+            {
+                // nikgub: we filled it, link the next one before anyone spins
+                advance_tail(current);
+            }
+            return true;
+        }
+    }
+
+    /**
+     * @brief Makes sure a block follows current and moves the tail there.
+     *
+     * current must be protected by the hazard of the caller.
+     */
+    void advance_tail (pointer current)
+    {
+        pointer next = current->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            pointer fresh = make_block();
+            if (current->next.compare_exchange_strong(
+                    next, fresh, std::memory_order_acq_rel,
+                    std::memory_order_acquire))
+            {
+                next = fresh;
+            }
+            else
+            {
+                // nikgub: someone was faster, fresh was never visible
+                destroy_block(fresh);
+            }
+        }
+        m_tail_block.compare_exchange_strong(current, next,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Retires a fully consumed block once no producer announces it.
+     *
+     * @param done block the consumer just left
+     * @param next block that follows it
+     */
+    void retire_block (pointer done, pointer next)
+    {
+        // nikgub: after this no producer can newly announce done
+        pointer expected = done;
+        m_tail_block.compare_exchange_strong(expected, next,
+                                             std::memory_order_seq_cst);
+        done->retired_next = m_retired;
+        m_retired          = done;
+
+        pointer *link = &m_retired;
+        while (*link != nullptr)
+        {
+            pointer candidate = *link;
+            if (announced(candidate))
+            {
+                link = &candidate->retired_next;
+                continue;
+            }
+            *link = candidate->retired_next;
+            destroy_block(candidate);
+        }
+    }
+
+    /**
+     * @brief Checks whether any producer still announces b.
+     */
+    bool announced (pointer b) const
+    {
+        for (const producer &p : m_producers)
+        {
+            if (p.hazard.load(std::memory_order_seq_cst) == b)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    pointer make_block ()
+    {
+        pointer b = block_allocator_traits::allocate(m_block_alloc, 1);
+        try
+        {
+            block_allocator_traits::construct(m_block_alloc, b);
+        }
+        catch (...)
+        {
+            block_allocator_traits::deallocate(m_block_alloc, b, 1);
+            throw;
+        }
+        return b;
+    }
+
+    void destroy_block (pointer b)
+    {
+        block_allocator_traits::destroy(m_block_alloc, b);
+        block_allocator_traits::deallocate(m_block_alloc, b, 1);
+    }
+};
+
+} // namespace ngg
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "mpsc_queue.hpp"
+#include "policy.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stop_token>
+#include <type_traits>
+#include <utility>
+
+namespace ngg
+{
+
+/**
+ * @brief Move-only void() callable with inline storage.
+ *
+ * Callables that fit Capacity bytes, need no more than max_align_t and
+ * move without throwing are stored in place. Anything else is wrapped in
+ * a std::move_only_function stored in the same buffer, which allocates
+ * only if the callable does not fit its own small buffer either.
+ *
+ * @tparam Capacity size of the inline buffer in bytes
+ */
+template <std::size_t Capacity>
+    requires(Capacity >= sizeof(std::move_only_function<void()>))
+class inline_task
+{
+  public:
+    /**
+     * @brief Stores func, inline if it fits.
+     *
+     * @param func callable invocable as func()
+     */
+    template <typename F>
+        requires(!std::same_as<std::remove_cvref_t<F>, inline_task> &&
+                 std::invocable<std::decay_t<F> &> &&
+                 std::constructible_from<std::decay_t<F>, F>)
+    inline_task (F &&func)
+    {
+        using stored = std::conditional_t<fits_inline<std::decay_t<F>>,
+                                          std::decay_t<F>,
+                                          std::move_only_function<void()>>;
+        std::construct_at(reinterpret_cast<stored *>(m_storage),
+                          std::forward<F>(func));
+        m_ops = &ops_for<stored>;
+    }
+
+    /**
+     * @brief Moves the callable of other, which stays moved-from.
+     */
+    inline_task (inline_task &&other) noexcept : m_ops(other.m_ops)
+    {
+        m_ops->move(m_storage, other.m_storage);
+    }
+
+    inline_task (const inline_task &)            = delete;
+    inline_task &operator= (const inline_task &) = delete;
+    inline_task &operator= (inline_task &&)      = delete;
+
+    ~inline_task ()
+    {
+        m_ops->destroy(m_storage);
+    }
+
+    void operator() ()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    /**
+     * @brief Checks whether F would be stored without the fallback.
+     */
+    template <typename F>
+    static constexpr bool fits_inline =
+        sizeof(F) <= Capacity && alignof(F) <= alignof(std::max_align_t) &&
+        std::is_nothrow_move_constructible_v<F>;
+
+  private:
+    struct ops
+    {
+        void (*invoke)(void *);
+        void (*move)(void *, void *) noexcept;
+        void (*destroy)(void *) noexcept;
+    };
+
+    template <typename F>
+    static F &as (void *p) noexcept
+    {
+        return *std::launder(static_cast<F *>(p));
+    }
+
+    template <typename F>
+    static constexpr ops ops_for{
+        [] (void *p) { std::invoke(as<F>(p)); },
+        [] (void *to, void *from) noexcept
+        { std::construct_at(static_cast<F *>(to), std::move(as<F>(from))); },
+        [] (void *p) noexcept { std::destroy_at(std::addressof(as<F>(p))); }};
+
+    alignas(std::max_align_t) std::byte m_storage[Capacity];
+    const ops *m_ops;
+};
+
+/**
+ * @brief Single-threaded executor fed by an mpsc_queue of tasks.
+ *
+ * Any thread submits, one thread runs the tasks in submission order per
+ * submitter. Tasks are inline_task objects built directly in the queue
+ * node, and with the default policy::pooled nodes are recycled, so a
+ * submission of a small callable is one exchange and no allocation once
+ * the pool is warm.
+ *
+ * The runner executes up to quantum tasks per batch, which is how often
+ * run() looks at its stop token and how long an external event loop
+ * calling run_batch() is kept busy. When idle, run() blocks in the
+ * queue's adaptive spin-then-park wait.
+ *
+ * @tparam Capacity inline storage of a task, see inline_task
+ * @tparam Policy policy bundle of the queue
+ */
+template <std::size_t Capacity       = 64,
+          types::queue_policy Policy = policy::pooled>
+class serial_executor
+{
+  public:
+    using task_type = inline_task<Capacity>;
+
+    static constexpr std::size_t default_quantum = 64;
+
+    /**
+     * @brief Constructs an executor.
+     *
+     * @param quantum maximal amount of tasks run per batch
+     */
+    explicit serial_executor (std::size_t quantum = default_quantum)
+        : m_quantum(std::max<std::size_t>(quantum, 1))
+    {
+    }
+
+    serial_executor (const serial_executor &)            = delete;
+    serial_executor &operator= (const serial_executor &) = delete;
+
+    /**
+     * @brief Queues a task, any thread.
+     *
+     * Tasks may submit further tasks.
+     *
+     * @param func callable invocable as func()
+     * @returns false if the executor is closed, func is dropped then
+     */
+    template <typename F>
+        requires std::constructible_from<task_type, F>
+    bool submit (F &&func)
+    {
+        return m_queue.emplace(std::forward<F>(func));
+    }
+
+    /**
+     * @brief Runs up to one quantum of ready tasks, never blocks.
+     *
+     * Runner only, must not be called from inside a task. An exception
+     * thrown by a task propagates, the tasks before it stay done.
+     *
+     * @returns amount of tasks run
+     */
+    std::size_t run_batch ()
+    {
+        return m_queue.consume_all(run_task, m_quantum);
+    }
+
+    /**
+     * @brief Runs tasks until stop is requested or closed and drained.
+     *
+     * Runner only. The token is looked at between batches and while idle.
+     * When the loop ends because the executor is closed, a final drain()
+     * runs every task whose submission had swapped the queue head by then,
+     * including ones still linking. Every submit() that returned true
+     * before close() was called is therefore run. A submit() racing
+     * close() may return true and link only after that drain, its task is
+     * then destroyed with the executor without running.
+     *
+     * @param token stop token that ends the loop
+     */
+    void run (std::stop_token token = {})
+    {
+        while (!token.stop_requested())
+        {
+            if (run_batch() != 0)
+            {
+                continue;
+            }
+            std::optional<task_type> task = m_queue.pull_wait(token);
+            if (!task)
+            {
+                break; // nikgub: stopped, or closed and empty
+            }
+            (*task)();
+        }
+        if (!token.stop_requested() && m_queue.is_closed())
+        {
+            m_queue.drain(run_task);
+        }
+    }
+
+    /**
+     * @brief Rejects submissions from now on.
+     *
+     * A running run() returns once the queued tasks are done, see run()
+     * for submissions racing this call.
+     */
+    void close () noexcept
+    {
+        m_queue.close();
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_queue.is_closed();
+    }
+
+    /**
+     * @brief Maximal amount of tasks run per batch.
+     */
+    std::size_t quantum () const noexcept
+    {
+        return m_quantum;
+    }
+
+  private:
+    static constexpr auto run_task = [] (task_type &&task) { task(); };
+
+    mpsc_queue<task_type, std::allocator<task_type>, Policy> m_queue;
+    const std::size_t m_quantum;
+};
+
+} // namespace ngg
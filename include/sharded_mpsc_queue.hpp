@@ -0,0 +1,487 @@
+#pragma once
+
+#include "clock.hpp"
+#include "policy.hpp"
+#include "thread_registry.hpp"
+#include "types.hpp"
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace ngg
+{
+
+namespace policy
+{
+
+/**
+ * @brief Lane order that visits lanes in turn.
+ *
+ * Elements of one producer come out in the order they were pushed, there is
+ * no ordering at all between producers.
+ */
+struct round_robin
+{
+    static constexpr bool stamped = false;
+};
+
+/**
+ * @brief Lane order that always serves the lane with the oldest head.
+ *
+ * Every element is stamped with detail::ticks() on push and the consumer
+ * picks the smallest stamp among the lane heads, which costs a pass over
+ * all lanes per element. Order across producers is approximate: pushes
+ * closer together than the skew between core clocks, or still in flight
+ * while the consumer looks, may come out swapped. Order within a producer
+ * is exact as with round_robin.
+ */
+struct approximate_fifo
+{
+    static constexpr bool stamped = true;
+};
+
+} // namespace policy
+
+/**
+ * @brief multiple producers/single consumer queue made of SPSC lanes
+ *
+ * Every producer thread gets a private unbounded SPSC lane on its first
+ * push, so pushing needs no RMW at all and producers never share a
+ * cacheline. Lanes recycle nodes the consumer is done with, which makes
+ * steady-state pushes allocation-free. The consumer merges lanes as
+ * configured by Order.
+ *
+ * @tparam T type of inner data
+ * @tparam Allocator allocator type, used for inner nodes
+ * @tparam Policy policy bundle, see policy::defaults
+ * @tparam Order how lanes are merged, policy::round_robin or
+ * policy::approximate_fifo
+ */
+template <types::queue_element T,
+          types::minimal_allocator_type<T> Allocator = std::allocator<T>,
+          types::queue_policy Policy                 = policy::defaults,
+          typename Order                             = policy::round_robin>
+class sharded_mpsc_queue
+{
+  protected:
+    struct node;
+    struct lane;
+    using value_type       = T;
+    using pointer          = node *;
+    using allocator_traits = typename std::allocator_traits<Allocator>;
+    using node_allocator   = allocator_traits::template rebind_alloc<node>;
+    using node_allocator_traits =
+        typename std::allocator_traits<node_allocator>;
+    using lane_iterator = typename thread_registry<lane>::iterator;
+
+  public:
+    /**
+     * @brief Constructs the queue, lanes are created lazily.
+     */
+    sharded_mpsc_queue () : m_node_alloc()
+    {
+    }
+
+    sharded_mpsc_queue (const sharded_mpsc_queue &)            = delete;
+    sharded_mpsc_queue &operator= (const sharded_mpsc_queue &) = delete;
+
+    /**
+     * @brief Destroys the queue and every element left in it.
+     */
+    ~sharded_mpsc_queue ()
+    {
+        clear();
+        for (lane &l : m_lanes)
+        {
+            pointer n = l.first;
+            while (n != nullptr)
+            {
+                pointer next = n->next.load(std::memory_order_relaxed);
+                destroy_node(n);
+                n = next;
+            }
+        }
+    }
+
+    /**
+     * @brief Copies and pushes a value to the lane of the caller.
+     *
+     * @param value value being copied
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (const T &value)
+    {
+        return push_impl(value);
+    }
+
+    /**
+     * @brief Pushes an rvalue to the lane of the caller.
+     *
+     * @param value value being forwarded
+     * @returns false if the queue is closed, nothing is pushed then
+     */
+    bool push (T &&value)
+    {
+        return push_impl(std::move(value));
+    }
+
+    /**
+     * @brief Constructs a value in place in the lane of the caller.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool emplace (Args &&...args)
+    {
+        return push_impl(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Pops one element from the lane picked by Order.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        std::optional<T> result;
+        consume_all([&result] (T &&value) { result.emplace(std::move(value)); },
+                    1);
+        return result;
+    }
+
+    /**
+     * @brief Pops up to max elements into an output iterator.
+     *
+     * @param out iterator the values are moved into
+     * @param max maximal amount of elements to pop
+     * @returns amount of elements popped
+     */
+    template <std::output_iterator<T> OutputIt>
+    std::size_t pull_bulk (OutputIt out, std::size_t max)
+    {
+        return consume_all([&out] (T &&value) { *out++ = std::move(value); },
+                           max);
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable.
+     *
+     * With round_robin every lane is drained by up to lane_batch elements
+     * before moving to the next one, with approximate_fifo the oldest head
+     * is picked for every element.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        if constexpr (Order::stamped)
+        {
+            return consume_oldest(func, max);
+        }
+        else
+        {
+            return consume_round_robin(func, max);
+        }
+    }
+
+    /**
+     * @brief Clears all the elements in the queue.
+     *
+     * Consumer only.
+     */
+    void clear ()
+    {
+        consume_all([] (T &&) {});
+    }
+
+    /**
+     * @brief Rejects all pushes from now on.
+     *
+     * Pushes that started before may still land, elements already queued
+     * stay and can be pulled. Safe from any thread, closing twice is fine.
+     */
+    void close () noexcept
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks whether close() was called.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_closed.load(std::memory_order_acquire);
+    }
+
+    // nikgub: lane quota per visit in round_robin mode
+    static constexpr std::size_t lane_batch = 64;
+
+  protected:
+    struct no_stamp
+    {
+    };
+
+    using stamp_type =
+        std::conditional_t<Order::stamped, std::uint64_t, no_stamp>;
+
+    /**
+     * @brief Lane node, same lifetime rules as the mpsc_queue node.
+     */
+    struct node
+    {
+        explicit node (node *next) : next(next)
+        {
+        }
+
+        // nikgub: data is not ours to destroy
+        ~node ()
+        {
+        }
+
+        std::atomic<node *> next;
+        [[no_unique_address]] stamp_type stamp;
+        union
+        {
+            T data;
+        };
+    };
+
+    /**
+     * @brief Unbounded SPSC queue, Vyukov's version with a node cache.
+     *
+     * Nodes in [first, tail) were consumed and may be reused by the
+     * producer, tail_copy caches the producer's last view of tail so the
+     * consumer's line is only read when the cache looks empty.
+     */
+    struct lane
+    {
+        // nikgub: consumer side, null until the producer set the lane up
+        alignas(Policy::field_alignment) std::atomic<node *> tail{nullptr};
+        // nikgub: producer side
+        alignas(Policy::field_alignment) node *head = nullptr;
+        node *first     = nullptr;
+        node *tail_copy = nullptr;
+    };
+
+  private:
+    thread_registry<lane> m_lanes;
+    std::atomic<bool> m_closed{false}; // nikgub: read-shared, set once
+    alignas(Policy::field_alignment) lane_iterator m_cursor; // consumer only
+    node_allocator m_node_alloc;
+
+  private:
+    /**
+     * @brief Implementation of push, RMW-free.
+     *
+     * @param args forwarding references to the constructor arguments
+     * @returns false if the queue is closed
+     */
+    template <typename... Args>
+    bool push_impl (Args &&...args)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        lane &self = m_lanes.local();
+        if (self.head == nullptr)
+        {
+            setup(self);
+        }
+        pointer new_node = acquire_node(self);
+        try
+        {
+            std::construct_at(std::addressof(new_node->data),
+                              std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            // nikgub: unlinked and ours, hand it straight back to the cache
+            new_node->next.store(self.first, std::memory_order_relaxed);
+            self.first = new_node;
+            throw;
+        }
+        if constexpr (Order::stamped)
+        {
+            new_node->stamp = detail::ticks();
+        }
+        self.head->next.store(new_node, std::memory_order_release);
+        self.head = new_node;
+        return true;
+    }
+
+    /**
+     * @brief Gives a fresh lane its sentinel, producer only.
+     */
+    void setup (lane &self)
+    {
+        pointer sentinel = make_node();
+        self.head        = sentinel;
+        self.first       = sentinel;
+        self.tail_copy   = sentinel;
+        // nikgub: release publishes the sentinel to the consumer
+        self.tail.store(sentinel, std::memory_order_release);
+    }
+
+    /**
+     * @brief Takes a consumed node from the lane cache or allocates one.
+     */
+    pointer acquire_node (lane &self)
+    {
+        if (self.first == self.tail_copy)
+        {
+            // nikgub: acquire pairs with the consumer's release of tail
+            self.tail_copy = self.tail.load(std::memory_order_acquire);
+        }
+        if (self.first != self.tail_copy)
+        {
+            pointer reused = self.first;
+            self.first     = reused->next.load(std::memory_order_relaxed);
+            reused->next.store(nullptr, std::memory_order_relaxed);
+            return reused;
+        }
+        return make_node();
+    }
+
+    /**
+     * @brief Consumes the head of a lane, if any.
+     *
+     * @returns false if the lane is empty
+     */
+    template <typename F>
+    static bool consume_one (lane &l, F &func)
+    {
+        // nikgub: acquire for the sentinel of a lane that was just set up
+        pointer tail_ptr = l.tail.load(std::memory_order_acquire);
+        if (tail_ptr == nullptr)
+        {
+            return false;
+        }
+        pointer next = tail_ptr->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+        try
+        {
+            func(std::move(next->data));
+        }
+        catch (...)
+        {
+            std::destroy_at(std::addressof(next->data));
+            l.tail.store(next, std::memory_order_release);
+            throw;
+        }
+        std::destroy_at(std::addressof(next->data));
+        // nikgub: hands tail_ptr over to the producer for reuse
+        l.tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Visits lanes in turn until a full round finds nothing.
+     */
+    template <typename F>
+    std::size_t consume_round_robin (F &func, std::size_t max)
+    {
+        std::size_t count = 0;
+        // nikgub: first lane of the current run of empty ones, coming back
+        //         to it means a full round found nothing, no lane count
+        //         needed
+        const lane *idle_from = nullptr;
+        while (count < max)
+        {
+            if (m_cursor == m_lanes.end())
+            {
+                m_cursor = m_lanes.begin();
+                if (m_cursor == m_lanes.end())
+                {
+                    break; // nikgub: nobody pushed yet
+                }
+            }
+            lane &l = *m_cursor;
+            if (&l == idle_from)
+            {
+                break;
+            }
+            ++m_cursor;
+            std::size_t served = 0;
+            while (served < lane_batch && count + served < max &&
+                   consume_one(l, func))
+            {
+                ++served;
+            }
+            count += served;
+            if (served != 0)
+            {
+                idle_from = nullptr;
+            }
+            else if (idle_from == nullptr)
+            {
+                idle_from = &l;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * @brief Serves the lane whose head carries the smallest stamp.
+     */
+    template <typename F>
+    std::size_t consume_oldest (F &func, std::size_t max)
+    {
+        std::size_t count = 0;
+        while (count < max)
+        {
+            lane *oldest        = nullptr;
+            std::uint64_t stamp = 0;
+            for (lane &l : m_lanes)
+            {
+                pointer tail_ptr = l.tail.load(std::memory_order_acquire);
+                if (tail_ptr == nullptr)
+                {
+                    continue;
+                }
+                pointer next = tail_ptr->next.load(std::memory_order_acquire);
+                if (next != nullptr &&
+                    (oldest == nullptr || next->stamp < stamp))
+                {
+                    oldest = &l;
+                    stamp  = next->stamp;
+                }
+            }
+            if (oldest == nullptr || !consume_one(*oldest, func))
+            {
+                break;
+            }
+            ++count;
+        }
+        return count;
+    }
+
+    pointer make_node ()
+    {
+        pointer n = node_allocator_traits::allocate(m_node_alloc, 1);
+        node_allocator_traits::construct(m_node_alloc, n, nullptr);
+        return n;
+    }
+
+    void destroy_node (pointer n)
+    {
+        node_allocator_traits::destroy(m_node_alloc, n);
+        node_allocator_traits::deallocate(m_node_alloc, n, 1);
+    }
+};
+
+} // namespace ngg
@@ -0,0 +1,543 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "types.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ngg
+{
+
+namespace detail
+{
+
+// nikgub: other processes see the same words, the atomics must be plain
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+/**
+ * @brief Control block at the start of a shared queue region.
+ *
+ * Everything a process needs to check that its view of the layout
+ * matches the one of the process that created the region, then the
+ * shared indices, each on its own cacheline.
+ */
+struct alignas(cache_line_size) shm_header
+{
+    static constexpr std::uint64_t expected_magic = 0x6e67672d6d707363;
+    static constexpr std::uint32_t layout_version = 1;
+
+    std::atomic<std::uint64_t> magic{0}; // nikgub: stored last by create()
+    std::uint32_t version    = layout_version;
+    std::uint32_t node_size  = 0;
+    std::uint32_t value_size = 0;
+    std::uint32_t capacity   = 0; // nikgub: nodes, sentinel included
+
+    alignas(cache_line_size) std::atomic<std::uint32_t> head{0};
+    std::atomic<std::uint32_t> closed{0}; // nikgub: producers read it anyway
+    alignas(cache_line_size) std::atomic<std::uint32_t> tail{0};
+    // nikgub: tag in the high half, index in the low half, see pop_free
+    alignas(cache_line_size) std::atomic<std::uint64_t> free{0};
+};
+
+/**
+ * @brief Memory orders of the handshakes in shm_mpsc_queue.
+ *
+ * tests/model_checks.cpp explores the free stack with exactly these.
+ */
+struct shm_orders
+{
+    // nikgub: push, head.exchange, then the release store of the link
+    static constexpr std::memory_order link_exchange =
+        std::memory_order_acq_rel;
+    static constexpr std::memory_order link_publish = std::memory_order_release;
+    // nikgub: pull, acquires the element
+    static constexpr std::memory_order pull_next = std::memory_order_acquire;
+    // nikgub: pop_free, the load of the top and both outcomes of the CAS
+    static constexpr std::memory_order free_pop = std::memory_order_acquire;
+    // nikgub: push_free, a successful CAS publishes the node
+    static constexpr std::memory_order free_push = std::memory_order_release;
+};
+
+} // namespace detail
+
+/**
+ * @brief multiple producers/single consumer queue shared between processes
+ *
+ * The same Michael-Scott queue as mpsc_queue, laid out inside a region
+ * that every process maps, e.g. a shm_segment. Nodes are a fixed array
+ * right after a shm_header, and head, tail and next hold node indices
+ * relative to that array instead of pointers, so the region may be mapped
+ * at a different address in every process. Free nodes form a Treiber
+ * stack whose head carries a tag bumped on every change, which defeats
+ * ABA among producers popping concurrently. A push is one CAS on the free
+ * stack and the usual single exchange on the head, a pull one CAS to give
+ * the old sentinel back. Values are written straight into the shared
+ * node, and consume_all() hands them out in place.
+ *
+ * T has to be trivially copyable, a value must not point into the private
+ * memory of a process. Only one process may consume at a time. A process
+ * that dies between claiming and linking a node loses that node and may
+ * leave the queue stuck behind it, so producers should not be killed
+ * while pushing.
+ *
+ * The object itself is a cheap per-process handle to the region, which
+ * must outlive it. Copy it freely inside one process.
+ *
+ * @tparam T type of inner data
+ */
+template <types::queue_element T>
+    requires std::is_trivially_copyable_v<T>
+class shm_mpsc_queue
+{
+    struct node
+    {
+        node () : next(0)
+        {
+        }
+
+        std::atomic<std::uint32_t> next; // nikgub: index, 0 means none
+        union
+        {
+            T data;
+        };
+    };
+
+    static constexpr std::size_t node_alignment =
+        std::max(cache_line_size, alignof(node));
+    // nikgub: a whole line per node, neighbours belong to other producers
+    static constexpr std::size_t node_stride =
+        (sizeof(node) + node_alignment - 1) & ~(node_alignment - 1);
+    static constexpr std::size_t nodes_offset =
+        (sizeof(detail::shm_header) + node_alignment - 1) &
+        ~(node_alignment - 1);
+    static constexpr std::uint64_t index_mask = UINT32_MAX;
+    using orders = detail::shm_orders;
+
+  public:
+    /**
+     * @brief Size of a region holding capacity elements.
+     */
+    static constexpr std::size_t required_bytes (std::size_t capacity) noexcept
+    {
+        return nodes_offset + (capacity + 1) * node_stride;
+    }
+
+    /**
+     * @brief Lays a new, empty queue out in a region.
+     *
+     * The region must be zeroed, as shm_segment and mmap hand it out,
+     * and nobody may attach before this returns. Uses as much of it as
+     * fits.
+     *
+     * @param region start of the region, aligned to a cacheline
+     * @param bytes size of the region
+     * @returns handle to the queue, throws std::invalid_argument if the
+     * region is too small or misaligned
+     */
+    static shm_mpsc_queue create (void *region, std::size_t bytes)
+    {
+        check_region(region, bytes);
+        const std::size_t nodes = std::min<std::size_t>(
+            (bytes - nodes_offset) / node_stride, index_mask - 1);
+        auto *header       = ::new (region) detail::shm_header();
+        header->node_size  = static_cast<std::uint32_t>(node_stride);
+        header->value_size = static_cast<std::uint32_t>(sizeof(T));
+        header->capacity   = static_cast<std::uint32_t>(nodes);
+        shm_mpsc_queue queue(header);
+        for (std::uint32_t i = 1; i <= nodes; ++i)
+        {
+            ::new (static_cast<void *>(queue.at(i))) node();
+        }
+        // nikgub: node 1 is the sentinel, every other one starts free
+        header->head.store(1, std::memory_order_relaxed);
+        header->tail.store(1, std::memory_order_relaxed);
+        for (std::uint32_t i = 2; i <= nodes; ++i)
+        {
+            queue.push_free(i);
+        }
+        // nikgub: release publishes the layout to attach()
+        header->magic.store(detail::shm_header::expected_magic,
+                            std::memory_order_release);
+        return queue;
+    }
+
+    /**
+     * @brief Opens a queue another process created in a region.
+     *
+     * @param region start of the region as mapped by this process
+     * @param bytes size of the region
+     * @returns handle to the queue, throws std::invalid_argument if the
+     * region holds no queue, or one of another layout or element type
+     */
+    static shm_mpsc_queue attach (void *region, std::size_t bytes)
+    {
+        check_region(region, bytes);
+        auto *header = std::launder(static_cast<detail::shm_header *>(region));
+        if (header->magic.load(std::memory_order_acquire) !=
+                detail::shm_header::expected_magic ||
+            header->version != detail::shm_header::layout_version)
+        {
+            throw std::invalid_argument("region holds no shm_mpsc_queue");
+        }
+        if (header->node_size != node_stride ||
+            header->value_size != sizeof(T) ||
+            nodes_offset + header->capacity * node_stride > bytes)
+        {
+            throw std::invalid_argument("shm_mpsc_queue layout mismatch");
+        }
+        return shm_mpsc_queue(header);
+    }
+
+    /**
+     * @brief Copies a value into the queue if a node is free.
+     *
+     * @param value value being copied
+     * @returns false if the queue is full or closed
+     */
+    bool try_push (const T &value)
+    {
+        return try_emplace(value);
+    }
+
+    /**
+     * @brief Constructs a value in a free node.
+     *
+     * @param args arguments forwarded to the constructor of T
+     * @returns false if the queue is full or closed, nothing is built then
+     */
+    template <typename... Args>
+        requires std::constructible_from<T, Args...>
+    bool try_emplace (Args &&...args)
+    {
+        if (is_closed())
+        {
+            return false;
+        }
+        const std::uint32_t index = pop_free();
+        if (index == 0)
+        {
+            return false;
+        }
+        node *n = at(index);
+        try
+        {
+            std::construct_at(std::addressof(n->data),
+                              std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            push_free(index);
+            throw;
+        }
+        n->next.store(0, std::memory_order_relaxed);
+        const std::uint32_t prev =
+            m_header->head.exchange(index, orders::link_exchange);
+        at(prev)->next.store(index, orders::link_publish);
+        return true;
+    }
+
+    /**
+     * @brief Pops the first element from the queue.
+     *
+     * Consumer only.
+     *
+     * @returns value if any, nullopt otherwise
+     */
+    std::optional<T> pull ()
+    {
+        std::optional<T> result;
+        consume_all([&result] (T &&value) { result.emplace(value); }, 1);
+        return result;
+    }
+
+    /**
+     * @brief Hands up to max elements to a callable, in place.
+     *
+     * Consumer only. Nodes go back to the free stack one by one, right
+     * after the call that received their value.
+     *
+     * @param func callable invoked as func(T&&)
+     * @param max maximal amount of elements to consume
+     * @returns amount of elements consumed
+     */
+    template <std::invocable<T &&> F>
+    std::size_t consume_all (F &&func, std::size_t max = SIZE_MAX)
+    {
+        std::uint32_t tail = m_header->tail.load(std::memory_order_relaxed);
+        std::size_t count  = 0;
+        while (count < max)
+        {
+            const std::uint32_t next =
+                at(tail)->next.load(orders::pull_next);
+            if (next == 0)
+            {
+                break;
+            }
+            try
+            {
+                func(std::move(at(next)->data));
+            }
+            catch (...)
+            {
+                advance(tail, next);
+                throw;
+            }
+            advance(tail, next);
+            tail = next;
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Drops every element that is fully pushed, consumer only.
+     */
+    void clear ()
+    {
+        consume_all([] (T &&) {});
+    }
+
+    /**
+     * @brief Rejects pushes from every process from now on.
+     */
+    void close () noexcept
+    {
+        m_header->closed.store(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks whether close() was called by any process.
+     */
+    bool is_closed () const noexcept
+    {
+        return m_header->closed.load(std::memory_order_acquire) != 0;
+    }
+
+    /**
+     * @brief Maximal amount of elements in the queue.
+     */
+    std::size_t capacity () const noexcept
+    {
+        return m_header->capacity - 1;
+    }
+
+  private:
+    explicit shm_mpsc_queue (detail::shm_header *header) : m_header(header)
+    {
+    }
+
+    static void check_region (void *region, std::size_t bytes)
+    {
+        if (reinterpret_cast<std::uintptr_t>(region) % node_alignment != 0)
+        {
+            throw std::invalid_argument("shm_mpsc_queue region misaligned");
+        }
+        if (bytes < required_bytes(1))
+        {
+            throw std::invalid_argument("shm_mpsc_queue region too small");
+        }
+    }
+
+    node *at (std::uint32_t index) const noexcept
+    {
+        auto *base = reinterpret_cast<std::byte *>(m_header) + nodes_offset;
+        return std::launder(
+            reinterpret_cast<node *>(base + (index - 1) * node_stride));
+    }
+
+    /**
+     * @brief Publishes next as the sentinel and frees the old one.
+     */
+    void advance (std::uint32_t tail, std::uint32_t next) noexcept
+    {
+        m_header->tail.store(next, std::memory_order_release);
+        push_free(tail);
+    }
+
+    /**
+     * @brief Takes a node off the free stack, any process.
+     *
+     * The next index of the top may be stale by the time it is read, the
+     * tag then differs and the CAS fails.
+     *
+     * @returns index of the node, 0 if none is free
+     */
+    std::uint32_t pop_free () noexcept
+    {
+        std::uint64_t top = m_header->free.load(orders::free_pop);
+        while (true)
+        {
+            const auto index = static_cast<std::uint32_t>(top & index_mask);
+            if (index == 0)
+            {
+                return 0;
+            }
+            const std::uint64_t next =
+                at(index)->next.load(std::memory_order_relaxed);
+            if (m_header->free.compare_exchange_weak(
+                    top, retag(top, next), orders::free_pop,
+                    orders::free_pop))
+            {
+                return index;
+            }
+        }
+    }
+
+    /**
+     * @brief Puts a node on the free stack, any process.
+     */
+    void push_free (std::uint32_t index) noexcept
+    {
+        std::uint64_t top = m_header->free.load(std::memory_order_relaxed);
+        do
+        {
+            at(index)->next.store(static_cast<std::uint32_t>(top & index_mask),
+                                  std::memory_order_relaxed);
+        } while (!m_header->free.compare_exchange_weak(
+            top, retag(top, index), orders::free_push,
+            std::memory_order_relaxed));
+    }
+
+    static std::uint64_t retag (std::uint64_t top, std::uint64_t index) noexcept
+    {
+        return ((top >> 32) + 1) << 32 | index;
+    }
+
+    detail::shm_header *m_header;
+};
+
+#if defined(__linux__) || defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief Owner of a mapping of a POSIX shared memory object.
+ *
+ * Created once by one process, opened by name by the others, unmapped
+ * when the owning object goes away. The name stays until unlink().
+ */
+class shm_segment
+{
+  public:
+    /**
+     * @brief Creates and maps a new zeroed object.
+     *
+     * @param name POSIX name, "/something"
+     * @param bytes size of the object
+     * @returns the mapping, throws std::system_error if the name exists
+     */
+    static shm_segment create (const char *name, std::size_t bytes)
+    {
+        const int fd = ::shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "shm_open");
+        }
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            ::shm_unlink(name);
+            throw std::system_error(error, std::system_category(),
+                                    "ftruncate");
+        }
+        return shm_segment(fd, bytes);
+    }
+
+    /**
+     * @brief Maps an existing object.
+     *
+     * @param name POSIX name the object was created with
+     * @returns the mapping, throws std::system_error on failure
+     */
+    static shm_segment open (const char *name)
+    {
+        const int fd = ::shm_open(name, O_RDWR, 0);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::system_category(),
+                                    "shm_open");
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::system_category(), "fstat");
+        }
+        return shm_segment(fd, static_cast<std::size_t>(info.st_size));
+    }
+
+    /**
+     * @brief Removes the name, mappings stay valid until unmapped.
+     */
+    static void unlink (const char *name) noexcept
+    {
+        ::shm_unlink(name);
+    }
+
+    shm_segment (shm_segment &&other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr)),
+          m_size(std::exchange(other.m_size, 0))
+    {
+    }
+
+    shm_segment (const shm_segment &)            = delete;
+    shm_segment &operator= (const shm_segment &) = delete;
+    shm_segment &operator= (shm_segment &&)      = delete;
+
+    ~shm_segment ()
+    {
+        if (m_data != nullptr)
+        {
+            ::munmap(m_data, m_size);
+        }
+    }
+
+    void *data () const noexcept
+    {
+        return m_data;
+    }
+
+    std::size_t size () const noexcept
+    {
+        return m_size;
+    }
+
+  private:
+    shm_segment (int fd, std::size_t bytes) : m_size(bytes)
+    {
+        void *mapped = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+        const int error = errno;
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::system_error(error, std::system_category(), "mmap");
+        }
+        m_data = mapped;
+    }
+
+    void *m_data = nullptr;
+    std::size_t m_size;
+};
+#endif
+
+} // namespace ngg
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "thread_registry.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ngg
+{
+
+/**
+ * @brief Snapshot of the counters of an instrumented queue.
+ *
+ * Counters are read one by one without stopping anybody, so a snapshot
+ * taken under traffic is consistent only approximately.
+ */
+struct queue_stats
+{
+    std::uint64_t enqueued    = 0; // nikgub: elements pushed
+    std::uint64_t dequeued    = 0; // nikgub: elements pulled or cleared
+    std::uint64_t empty_polls = 0; // nikgub: pulls that found nothing
+    std::uint64_t depth       = 0; // nikgub: enqueued - dequeued
+    std::uint64_t high_water  = 0; // nikgub: largest depth seen
+};
+
+} // namespace ngg
+
+namespace ngg::policy
+{
+
+/**
+ * @brief Stats policy that records nothing and compiles to nothing.
+ */
+struct no_stats
+{
+    static constexpr bool enabled = false;
+
+    class recorder
+    {
+      public:
+        void on_push (std::size_t) noexcept
+        {
+        }
+
+        void on_pull (std::size_t) noexcept
+        {
+        }
+
+        void on_empty_poll () noexcept
+        {
+        }
+    };
+};
+
+/**
+ * @brief Stats policy that counts on the hot path without shared RMWs.
+ *
+ * Every producer bumps its own counter in a per-thread slot, the consumer
+ * owns the dequeue and empty poll counters. All of them are single-writer,
+ * so updates are a relaxed load and store to a line nobody else writes.
+ * The high-water mark is sampled by the consumer every sample_period
+ * dequeue calls and on every snapshot.
+ */
+struct counting_stats
+{
+    static constexpr bool enabled = true;
+
+    static constexpr std::uint32_t sample_period = 64;
+
+    class recorder
+    {
+        struct producer
+        {
+            std::atomic<std::uint64_t> enqueued{0};
+        };
+
+      public:
+        void on_push (std::size_t n) noexcept
+        {
+            producer &self = m_producers.local();
+            bump(self.enqueued, n);
+        }
+
+        void on_pull (std::size_t n) noexcept
+        {
+            if (--m_until_sample == 0)
+            {
+                m_until_sample = sample_period;
+                observe(depth());
+            }
+            bump(m_dequeued, n);
+        }
+
+        void on_empty_poll () noexcept
+        {
+            bump(m_empty_polls, 1);
+        }
+
+        /**
+         * @brief Reads all the counters, safe from any thread.
+         */
+        queue_stats snapshot () const noexcept
+        {
+            queue_stats result;
+            result.dequeued = m_dequeued.load(std::memory_order_relaxed);
+            result.enqueued = enqueued();
+            result.empty_polls =
+                m_empty_polls.load(std::memory_order_relaxed);
+            result.depth = result.enqueued > result.dequeued
+                               ? result.enqueued - result.dequeued
+                               : 0;
+            result.high_water = std::max(
+                result.depth, m_high_water.load(std::memory_order_relaxed));
+            return result;
+        }
+
+        /**
+         * @brief Estimated amount of queued elements, safe from any thread.
+         */
+        std::uint64_t depth () const noexcept
+        {
+            const std::uint64_t out =
+                m_dequeued.load(std::memory_order_relaxed);
+            const std::uint64_t in = enqueued();
+            return in > out ? in - out : 0;
+        }
+
+      private:
+        static void bump (std::atomic<std::uint64_t> &counter,
+                          std::size_t n) noexcept
+        {
+            // nikgub: single writer, no RMW needed
+            counter.store(counter.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        }
+
+        std::uint64_t enqueued () const noexcept
+        {
+            std::uint64_t total = 0;
+            for (const producer &p : m_producers)
+            {
+                total += p.enqueued.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        void observe (std::uint64_t depth) noexcept
+        {
+            if (depth > m_high_water.load(std::memory_order_relaxed))
+            {
+                m_high_water.store(depth, std::memory_order_relaxed);
+            }
+        }
+
+        thread_registry<producer> m_producers;
+        alignas(cache_line_size) std::atomic<std::uint64_t> m_dequeued{0};
+        std::atomic<std::uint64_t> m_empty_polls{0};
+        std::atomic<std::uint64_t> m_high_water{0};
+        std::uint32_t m_until_sample = sample_period;
+    };
+};
+
+/**
+ * @brief Stats policy that only tracks the depth of the queue.
+ *
+ * Keeps the per-producer enqueue counters and the consumer's dequeue
+ * counter of counting_stats and nothing else, which is all approx_size()
+ * needs. Hot path cost is a relaxed load and store to a line owned by the
+ * writing thread, no shared RMW.
+ */
+struct depth_stats
+{
+    static constexpr bool enabled = false; // nikgub: no full snapshot
+
+    class recorder
+    {
+        struct producer
+        {
+            std::atomic<std::uint64_t> enqueued{0};
+        };
+
+      public:
+        void on_push (std::size_t n) noexcept
+        {
+            std::atomic<std::uint64_t> &counter = m_producers.local().enqueued;
+            counter.store(counter.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        }
+
+        void on_pull (std::size_t n) noexcept
+        {
+            m_dequeued.store(m_dequeued.load(std::memory_order_relaxed) + n,
+                             std::memory_order_relaxed);
+        }
+
+        void on_empty_poll () noexcept
+        {
+        }
+
+        /**
+         * @brief Estimated amount of queued elements, safe from any thread.
+         */
+        std::uint64_t depth () const noexcept
+        {
+            // nikgub: dequeued first, so racing pulls can only make the
+            //         estimate larger, the clamp covers relaxed reordering
+            const std::uint64_t out =
+                m_dequeued.load(std::memory_order_relaxed);
+            std::uint64_t in = 0;
+            for (const producer &p : m_producers)
+            {
+                in += p.enqueued.load(std::memory_order_relaxed);
+            }
+            return in > out ? in - out : 0;
+        }
+
+      private:
+        thread_registry<producer> m_producers;
+        alignas(cache_line_size) std::atomic<std::uint64_t> m_dequeued{0};
+    };
+};
+
+} // namespace ngg::policy
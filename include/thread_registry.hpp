@@ -0,0 +1,191 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+
+namespace ngg
+{
+
+namespace detail
+{
+
+/**
+ * @brief Source of process-unique registry ids.
+ *
+ * Ids are never reused, so a stale thread-local memo can never match a
+ * registry that was created at the address of a destroyed one.
+ */
+inline std::atomic<std::uint64_t> registry_ids{1};
+
+} // namespace detail
+
+/**
+ * @brief Lock-free registry of per-thread slots owned by a single object.
+ *
+ * Every thread that calls local() gets its own slot, created on first use
+ * and kept until the registry is destroyed. Slots are linked into an
+ * append-only list so that any thread can walk all of them.
+ * A slot is keyed by std::thread::id, so a thread that reuses the id of an
+ * exited one inherits its slot, which is fine since they never overlap.
+ *
+ * @tparam Slot per-thread state, must be default-constructible
+ */
+template <typename Slot>
+class thread_registry
+{
+  protected:
+    // nikgub: one cacheline per entry so neighbouring threads do not share
+    struct alignas(cache_line_size) entry
+    {
+        Slot slot{};
+        entry *next = nullptr;
+        std::thread::id owner;
+    };
+
+  public:
+    /**
+     * @brief Forward iterator over all registered slots.
+     */
+    class iterator
+    {
+      public:
+        using value_type        = Slot;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator () = default;
+
+        explicit iterator (entry *e) : m_entry(e)
+        {
+        }
+
+        Slot &operator* () const
+        {
+            return m_entry->slot;
+        }
+
+        Slot *operator->() const
+        {
+            return &m_entry->slot;
+        }
+
+        iterator &operator++ ()
+        {
+            m_entry = m_entry->next;
+            return *this;
+        }
+
+        iterator operator++ (int)
+        {
+            iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator== (const iterator &) const = default;
+
+      private:
+        entry *m_entry = nullptr;
+    };
+
+    thread_registry ()
+        : m_id(detail::registry_ids.fetch_add(1, std::memory_order_relaxed))
+    {
+    }
+
+    thread_registry (const thread_registry &)            = delete;
+    thread_registry &operator= (const thread_registry &) = delete;
+
+    ~thread_registry ()
+    {
+        entry *e = m_entries.load(std::memory_order_acquire);
+        while (e != nullptr)
+        {
+            entry *next = e->next;
+            delete e;
+            e = next;
+        }
+    }
+
+    /**
+     * @brief Returns the slot of the calling thread.
+     *
+     * The fast path is a single thread-local compare. The first call from a
+     * thread walks the list and appends a new slot if none is found.
+     */
+    Slot &local ()
+    {
+        memo &cached = memo_for(m_id);
+        if (cached.id == m_id)
+        {
+            return cached.slot->slot;
+        }
+        entry *e = find_or_insert();
+        cached   = {m_id, e};
+        return e->slot;
+    }
+
+    /**
+     * @brief Iterator to the newest registered slot.
+     *
+     * Walking is safe concurrently with registration, slots appended
+     * after begin() was taken are simply not visited.
+     */
+    iterator begin () const
+    {
+        return iterator(m_entries.load(std::memory_order_acquire));
+    }
+
+    iterator end () const
+    {
+        return iterator();
+    }
+
+  private:
+    struct memo
+    {
+        std::uint64_t id = 0;
+        entry *slot      = nullptr;
+    };
+
+    // nikgub: small direct-mapped cache, a thread rarely talks to more than a
+    //         handful of queues at a time
+    static memo &memo_for (std::uint64_t id)
+    {
+        thread_local memo memos[8];
+        return memos[id & 7];
+    }
+
+    entry *find_or_insert ()
+    {
+        const std::thread::id self = std::this_thread::get_id();
+        entry *head                = m_entries.load(std::memory_order_acquire);
+        for (entry *e = head; e != nullptr; e = e->next)
+        {
+            if (e->owner == self)
+            {
+                return e;
+            }
+        }
+        entry *created = new entry();
+        created->owner = self;
+        created->next  = head;
+        // nikgub: only the calling thread can insert its own id, so losing
+        //         the race never means someone else registered us
+        while (!m_entries.compare_exchange_weak(created->next, created,
+                                                std::memory_order_release,
+                                                std::memory_order_acquire))
+        {
+        }
+        return created;
+    }
+
+    std::atomic<entry *> m_entries{nullptr};
+    const std::uint64_t m_id;
+};
+
+} // namespace ngg
@@ -0,0 +1,301 @@
+#pragma once
+
+#include "cache_line.hpp"
+#include "clock.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace ngg
+{
+
+/**
+ * @brief Log-linear histogram of latencies in detail::ticks() units.
+ *
+ * Values below 2^SubBits get a bucket each, every power of two above is
+ * split into 2^SubBits equal buckets, so a bucket is never wider than a
+ * 2^-SubBits fraction of its lower bound, like an HDR histogram with
+ * SubBits bits of precision. This is the plain snapshot type, a queue
+ * records into a live copy and hands out these.
+ *
+ * @tparam SubBits bits of precision, 2^SubBits buckets per power of two
+ */
+template <unsigned SubBits = 4>
+    requires(SubBits > 0 && SubBits < 16)
+class latency_histogram
+{
+  public:
+    static constexpr std::size_t sub_buckets  = std::size_t{1} << SubBits;
+    static constexpr std::size_t bucket_count = (65 - SubBits) * sub_buckets;
+
+    /**
+     * @brief Bucket a value falls into.
+     */
+    static constexpr std::size_t index_of (std::uint64_t value) noexcept
+    {
+        if (value < sub_buckets)
+        {
+            return static_cast<std::size_t>(value);
+        }
+        const unsigned shift = std::bit_width(value) - 1 - SubBits;
+        return (shift << SubBits) + static_cast<std::size_t>(value >> shift);
+    }
+
+    /**
+     * @brief Smallest value of a bucket.
+     */
+    static constexpr std::uint64_t lower_bound (std::size_t index) noexcept
+    {
+        if (index < sub_buckets)
+        {
+            return index;
+        }
+        const unsigned shift = (index >> SubBits) - 1;
+        return (sub_buckets + (index & (sub_buckets - 1))) << shift;
+    }
+
+    /**
+     * @brief Largest value of a bucket.
+     */
+    static constexpr std::uint64_t upper_bound (std::size_t index) noexcept
+    {
+        return index + 1 == bucket_count ? UINT64_MAX
+                                         : lower_bound(index + 1) - 1;
+    }
+
+    /**
+     * @brief Counts one value.
+     */
+    void record (std::uint64_t value) noexcept
+    {
+        ++m_counts[index_of(value)];
+    }
+
+    /**
+     * @brief Amount of values in a bucket.
+     */
+    std::uint64_t bucket (std::size_t index) const noexcept
+    {
+        return m_counts[index];
+    }
+
+    /**
+     * @brief Amount of values recorded.
+     */
+    std::uint64_t count () const noexcept
+    {
+        std::uint64_t total = 0;
+        for (const std::uint64_t n : m_counts)
+        {
+            total += n;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Value at or below which a q fraction of the values lie.
+     *
+     * @param q fraction in [0, 1], 0.99 for the 99th percentile
+     * @returns upper bound of the bucket holding it, 0 if empty
+     */
+    std::uint64_t percentile (double q) const noexcept
+    {
+        const std::uint64_t total = count();
+        if (total == 0)
+        {
+            return 0;
+        }
+        const double clamped = q < 0 ? 0 : (q > 1 ? 1 : q);
+        // nikgub: nearest rank, 1-based, so p99 of 10 values is the 10th
+        std::uint64_t rank =
+            static_cast<std::uint64_t>(std::ceil(clamped * total));
+        rank = std::clamp<std::uint64_t>(rank, 1, total);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            seen += m_counts[i];
+            if (seen >= rank)
+            {
+                return upper_bound(i);
+            }
+        }
+        return upper_bound(bucket_count - 1);
+    }
+
+    /**
+     * @brief Hands every non-empty bucket to func, lowest first.
+     *
+     * @param func invoked as func(lower_bound, upper_bound, count)
+     */
+    template <typename F>
+    void for_each (F &&func) const
+    {
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            if (m_counts[i] != 0)
+            {
+                func(lower_bound(i), upper_bound(i), m_counts[i]);
+            }
+        }
+    }
+
+    /**
+     * @brief Adds the counts of other, e.g. to merge several queues.
+     */
+    latency_histogram &operator+= (const latency_histogram &other) noexcept
+    {
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            m_counts[i] += other.m_counts[i];
+        }
+        return *this;
+    }
+
+  private:
+    template <unsigned>
+    friend class live_histogram;
+
+    std::array<std::uint64_t, bucket_count> m_counts{};
+};
+
+/**
+ * @brief latency_histogram with a single writer and readers anywhere.
+ *
+ * Buckets are atomics bumped with a relaxed load and store, so recording
+ * is no dearer than a plain increment and a snapshot never stops the
+ * writer. A snapshot taken under traffic may miss the latest values.
+ */
+template <unsigned SubBits = 4>
+class live_histogram
+{
+    using histogram = latency_histogram<SubBits>;
+
+  public:
+    /**
+     * @brief Counts one value, writer only.
+     */
+    void record (std::uint64_t value) noexcept
+    {
+        std::atomic<std::uint64_t> &n = m_counts[histogram::index_of(value)];
+        n.store(n.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Copies the counts, safe from any thread.
+     */
+    histogram snapshot () const noexcept
+    {
+        histogram result;
+        for (std::size_t i = 0; i < histogram::bucket_count; ++i)
+        {
+            result.m_counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+  private:
+    std::array<std::atomic<std::uint64_t>, histogram::bucket_count>
+        m_counts{};
+};
+
+} // namespace ngg
+
+namespace ngg::policy
+{
+
+/**
+ * @brief Tracing policy that stamps nothing and compiles to nothing.
+ */
+struct no_tracing
+{
+    static constexpr bool enabled = false;
+
+    /**
+     * @brief What a node carries for tracing, nothing here.
+     */
+    struct stamp
+    {
+    };
+
+    class tracer
+    {
+      public:
+        void on_push (stamp &) noexcept
+        {
+        }
+
+        void on_pull (const stamp &) noexcept
+        {
+        }
+    };
+};
+
+/**
+ * @brief Tracing policy that measures queueing delay of sampled elements.
+ *
+ * Every producer stamps one in Every of its pushes with detail::ticks(),
+ * the other nodes keep a zero stamp. The consumer records now minus the
+ * stamp of every sampled node it takes into a live_histogram, so the
+ * unsampled path costs producers a thread-local countdown and the
+ * consumer a load of a word next to the value. Deltas are in ticks, TSC
+ * cycles on x86, see detail::ticks_per_nanosecond() to convert.
+ *
+ * @tparam Every sampling period per producer
+ * @tparam SubBits precision of the histogram, see latency_histogram
+ */
+template <std::uint32_t Every = 64, unsigned SubBits = 4>
+    requires(Every > 0)
+struct sampled_tracing
+{
+    static constexpr bool enabled = true;
+
+    using histogram = latency_histogram<SubBits>;
+
+    struct stamp
+    {
+        std::uint64_t ticks = 0; // nikgub: 0 means not sampled
+    };
+
+    class tracer
+    {
+      public:
+        void on_push (stamp &s) noexcept
+        {
+            // nikgub: shared by every queue of this policy, fine to sample
+            thread_local std::uint32_t until_sample = Every;
+            if (--until_sample == 0)
+            {
+                until_sample = Every;
+                s.ticks      = detail::ticks();
+            }
+        }
+
+        void on_pull (const stamp &s) noexcept
+        {
+            if (s.ticks != 0)
+            {
+                const std::uint64_t now = detail::ticks();
+                // nikgub: clocks of two cores may disagree by a few ticks
+                m_latency.record(now > s.ticks ? now - s.ticks : 0);
+            }
+        }
+
+        /**
+         * @brief Copies the histogram, safe from any thread.
+         */
+        histogram snapshot () const noexcept
+        {
+            return m_latency.snapshot();
+        }
+
+      private:
+        alignas(cache_line_size) live_histogram<SubBits> m_latency;
+    };
+};
+
+} // namespace ngg::policy
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <bit>
 #include <concepts>
+#include <coroutine>
+#include <cstddef>
 #include <type_traits>
 
 namespace ngg::types
@@ -14,6 +17,14 @@ namespace ngg::types
 template <typename Tt>
 concept default_constructible = std::is_default_constructible_v<Tt>;
 
+/**
+ * @brief Concept for a type that can be stored in a queue
+ *
+ * @tparam Tt type to validate
+ */
+template <typename Tt>
+concept queue_element = std::is_object_v<Tt> && std::destructible<Tt>;
+
 /**
  * @brief Concept for a default-constructible type
  *
@@ -26,4 +37,124 @@ concept minimal_allocator_type =
         { alloc.deallocate(mem, n) } -> std::same_as<void>;
     };
 
+/**
+ * @brief Concept for a node pool policy
+ *
+ * @tparam Pool pool policy to validate
+ */
+template <typename Pool>
+concept node_pool_policy = requires {
+    typename Pool::hook;
+    requires std::is_default_constructible_v<typename Pool::hook>;
+};
+
+/**
+ * @brief Concept for a stats policy
+ *
+ * @tparam Stats stats policy to validate
+ */
+template <typename Stats>
+concept stats_policy = requires(typename Stats::recorder recorder) {
+    { Stats::enabled } -> std::convertible_to<bool>;
+    recorder.on_push(std::size_t{});
+    recorder.on_pull(std::size_t{});
+    recorder.on_empty_poll();
+};
+
+/**
+ * @brief Concept for a notifier policy
+ *
+ * @tparam Notifier notifier policy to validate
+ */
+template <typename Notifier>
+concept notifier_policy = requires(typename Notifier::handle handle) {
+    { Notifier::enabled } -> std::convertible_to<bool>;
+    handle.notify();
+    handle.reset();
+};
+
+/**
+ * @brief Concept for a reclamation policy
+ *
+ * @tparam Reclaim reclamation policy to validate
+ */
+template <typename Reclaim>
+concept reclaim_policy = requires {
+    { Reclaim::deferred } -> std::convertible_to<bool>;
+    typename Reclaim::template domain<std::byte>;
+};
+
+/**
+ * @brief Concept for a capacity policy
+ *
+ * @tparam Capacity capacity policy to validate
+ */
+template <typename Capacity>
+concept capacity_policy = requires(typename Capacity::gate gate) {
+    { Capacity::enabled } -> std::convertible_to<bool>;
+    { gate.try_admit(std::size_t{}) } -> std::convertible_to<bool>;
+    gate.cancel(std::size_t{});
+    gate.on_pull(std::size_t{});
+    gate.on_idle();
+    gate.wake_all();
+};
+
+/**
+ * @brief Concept for a tracing policy
+ *
+ * @tparam Tracing tracing policy to validate
+ */
+template <typename Tracing>
+concept tracing_policy =
+    std::is_default_constructible_v<typename Tracing::stamp> &&
+    requires(typename Tracing::tracer tracer, typename Tracing::stamp stamp,
+             const typename Tracing::stamp &stamped) {
+        { Tracing::enabled } -> std::convertible_to<bool>;
+        tracer.on_push(stamp);
+        tracer.on_pull(stamped);
+    };
+
+/**
+ * @brief Concept for a queue policy bundle
+ *
+ * @tparam Policy policy to validate
+ */
+template <typename Policy>
+concept queue_policy =
+    node_pool_policy<typename Policy::node_pool> &&
+    stats_policy<typename Policy::stats> &&
+    notifier_policy<typename Policy::notifier> &&
+    capacity_policy<typename Policy::capacity> &&
+    tracing_policy<typename Policy::tracing> && requires {
+        { Policy::field_alignment } -> std::convertible_to<std::size_t>;
+        { Policy::prefetch_distance } -> std::convertible_to<std::size_t>;
+    } && std::has_single_bit(std::size_t{Policy::field_alignment});
+
+/**
+ * @brief Concept for a type that is one of a list of types
+ *
+ * @tparam Tt type to validate
+ * @tparam Ts allowed types
+ */
+template <typename Tt, typename... Ts>
+concept one_of = (std::same_as<Tt, Ts> || ...);
+
+/**
+ * @brief Concept for a callable that accepts every alternative as an rvalue
+ *
+ * @tparam Visitor callable to validate
+ * @tparam Ts alternatives it is invoked with
+ */
+template <typename Visitor, typename... Ts>
+concept message_visitor = (std::invocable<Visitor &, Ts &&> && ...);
+
+/**
+ * @brief Concept for something that can resume a coroutine elsewhere
+ *
+ * @tparam Scheduler callable invoked with the handle to resume
+ */
+template <typename Scheduler>
+concept coroutine_scheduler =
+    std::invocable<Scheduler &, std::coroutine_handle<>>;
+
 } // namespace ngg::types
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace ngg::test
+{
+
+namespace detail
+{
+
+inline int &failures () noexcept
+{
+    static int count = 0;
+    return count;
+}
+
+} // namespace detail
+
+/**
+ * @brief Records a failed expectation, the test keeps going.
+ *
+ * @returns ok, so that callers can bail out of a case early
+ */
+inline bool expect (bool ok, const char *expr, const char *file, int line)
+{
+    if (!ok)
+    {
+        std::fprintf(stderr, "%s:%d: expected %s\n", file, line, expr);
+        ++detail::failures();
+    }
+    return ok;
+}
+
+/**
+ * @brief Runs one case, an escaping exception counts as a failure.
+ *
+ * @param name printed with the outcome
+ * @param body callable without arguments
+ */
+template <typename F>
+void run (const char *name, F &&body)
+{
+    const int before = detail::failures();
+    try
+    {
+        body();
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s: threw %s\n", name, e.what());
+        ++detail::failures();
+    }
+    catch (...)
+    {
+        std::fprintf(stderr, "%s: threw\n", name);
+        ++detail::failures();
+    }
+    std::printf("%-40s %s\n", name,
+                detail::failures() == before ? "ok" : "FAILED");
+    std::fflush(stdout);
+}
+
+/**
+ * @brief Element of the FIFO checks, who pushed it and its place in line.
+ */
+struct tagged
+{
+    std::uint32_t producer = 0;
+    std::uint64_t seq      = 0;
+};
+
+/**
+ * @brief Producers push concurrently, one consumer checks that every
+ * producer's elements come out once, in order.
+ *
+ * @param queue queue under test, empty
+ * @param push callable as push(queue, tagged) from each producer thread,
+ *        retries on its own if the queue may turn it away
+ * @param pull callable as pull(queue, sink), hands what it takes to
+ *        sink(tagged) and returns how many that was
+ * @param producers amount of producer threads
+ * @param per amount of elements each producer pushes
+ * @returns true if the order held and the queue ended up empty
+ */
+template <typename Queue, typename Push, typename Pull>
+bool check_fifo (Queue &queue, Push push, Pull pull, std::uint32_t producers,
+                 std::uint64_t per)
+{
+    std::vector<std::jthread> threads;
+    for (std::uint32_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back(
+            [&queue, &push, p, per]
+            {
+                for (std::uint64_t seq = 0; seq < per; ++seq)
+                {
+                    push(queue, tagged{p, seq});
+                }
+            });
+    }
+    std::vector<std::uint64_t> next(producers, 0);
+    std::uint64_t consumed = 0;
+    bool ordered           = true;
+    auto sink              = [&] (const tagged &t)
+    {
+        ordered =
+            ordered && t.producer < producers && t.seq == next[t.producer];
+        ++next[t.producer];
+    };
+    while (consumed < producers * per)
+    {
+        const std::size_t taken = pull(queue, sink);
+        if (taken == 0)
+        {
+            std::this_thread::yield();
+        }
+        consumed += taken;
+    }
+    threads.clear();
+    return ordered && pull(queue, sink) == 0;
+}
+
+/**
+ * @brief Exit code of a test binary, non-zero if anything failed.
+ */
+inline int finish () noexcept
+{
+    return detail::failures() == 0 ? 0 : 1;
+}
+
+} // namespace ngg::test
+
+#define NGG_EXPECT(cond) ::ngg::test::expect((cond), #cond, __FILE__, __LINE__)
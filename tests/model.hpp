@@ -0,0 +1,1022 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * @brief Stateless model checker for litmus tests of the queue protocols.
+ *
+ * A model restates a protocol with model::atomic and model::plain in
+ * place of std::atomic and ordinary fields, its threads are coroutines
+ * that co_await every atomic operation. explore() runs the model over and
+ * over, depth first over every interleaving of those operations and every
+ * value a load may read, until one execution breaks an expectation,
+ * races on a plain field, or leaves a thread parked forever.
+ *
+ * Memory follows the release/acquire fragment of C++ in its view based
+ * form: every thread knows a prefix of the modification order of each
+ * location, a load reads anything past that prefix, an acquire load
+ * learns what the release store it read from knew. RMWs read the latest
+ * value and continue release sequences. seq_cst operations additionally
+ * go through one global view, which forbids store buffering the way the
+ * single total order does. Stores always land at the end of the
+ * modification order and loads never read from the future, so the model
+ * is a little stronger than C++ and can miss bugs, but it never reports
+ * an outcome the standard forbids.
+ */
+namespace ngg::model
+{
+
+// nikgub: the orders of the real atomics, so models take them verbatim
+using order = std::memory_order;
+
+class execution;
+
+template <typename T = void>
+class task;
+
+namespace detail
+{
+
+// nikgub: one entry per location and per thread, see execution::slot
+using view = std::vector<std::uint32_t>;
+
+inline void raise (view &v, std::size_t slot, std::uint32_t value)
+{
+    if (v.size() <= slot)
+    {
+        v.resize(slot + 1, 0);
+    }
+    v[slot] = std::max(v[slot], value);
+}
+
+inline void join (view &into, const view &from)
+{
+    if (into.size() < from.size())
+    {
+        into.resize(from.size(), 0);
+    }
+    for (std::size_t i = 0; i < from.size(); ++i)
+    {
+        into[i] = std::max(into[i], from[i]);
+    }
+}
+
+inline std::uint32_t at (const view &v, std::size_t slot) noexcept
+{
+    return slot < v.size() ? v[slot] : 0;
+}
+
+constexpr bool acquires (order o) noexcept
+{
+    return o == order::consume || o == order::acquire ||
+           o == order::acq_rel || o == order::seq_cst;
+}
+
+constexpr bool releases (order o) noexcept
+{
+    return o == order::release || o == order::acq_rel || o == order::seq_cst;
+}
+
+/**
+ * @brief Final awaiter of a task, continues whoever co_awaited it.
+ */
+struct transfer
+{
+    bool await_ready () noexcept
+    {
+        return false;
+    }
+
+    template <typename P>
+    std::coroutine_handle<>
+    await_suspend (std::coroutine_handle<P> self) noexcept
+    {
+        const std::coroutine_handle<> next = self.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+
+    void await_resume () noexcept
+    {
+    }
+};
+
+struct promise_base
+{
+    std::suspend_always initial_suspend () noexcept
+    {
+        return {};
+    }
+
+    transfer final_suspend () noexcept
+    {
+        return {};
+    }
+
+    void unhandled_exception () noexcept
+    {
+        error = std::current_exception();
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+};
+
+template <typename T>
+struct promise : promise_base
+{
+    task<T> get_return_object () noexcept;
+
+    void return_value (T v)
+    {
+        value.emplace(std::move(v));
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct promise<void> : promise_base
+{
+    task<void> get_return_object () noexcept;
+
+    void return_void () noexcept
+    {
+    }
+};
+
+/**
+ * @brief Choices of one execution, replayed and advanced depth first.
+ */
+class schedule
+{
+  public:
+    /**
+     * @brief Picks one of options, the recorded one while replaying.
+     */
+    std::size_t choose (std::size_t options)
+    {
+        if (options <= 1)
+        {
+            return 0;
+        }
+        if (m_position < m_choices.size())
+        {
+            return m_choices[m_position++].taken;
+        }
+        m_choices.push_back({0, options});
+        ++m_position;
+        return 0;
+    }
+
+    /**
+     * @brief Moves to the next unexplored sequence of choices.
+     *
+     * @returns false once every sequence was explored
+     */
+    bool advance ()
+    {
+        m_choices.resize(m_position);
+        while (!m_choices.empty() &&
+               m_choices.back().taken + 1 == m_choices.back().options)
+        {
+            m_choices.pop_back();
+        }
+        m_position = 0;
+        if (m_choices.empty())
+        {
+            return false;
+        }
+        ++m_choices.back().taken;
+        return true;
+    }
+
+    /**
+     * @brief Replays the current sequence from the start.
+     */
+    void rewind () noexcept
+    {
+        m_position = 0;
+    }
+
+  private:
+    struct choice
+    {
+        std::size_t taken;
+        std::size_t options;
+    };
+
+    std::vector<choice> m_choices;
+    std::size_t m_position = 0;
+};
+
+} // namespace detail
+
+/**
+ * @brief Coroutine of a model thread, or of a helper it co_awaits.
+ */
+template <typename T>
+class task
+{
+  public:
+    using promise_type = detail::promise<T>;
+
+    explicit task (std::coroutine_handle<promise_type> handle) noexcept
+        : m_handle(handle)
+    {
+    }
+
+    task (task &&other) noexcept : m_handle(std::exchange(other.m_handle, {}))
+    {
+    }
+
+    task (const task &)            = delete;
+    task &operator= (const task &) = delete;
+    task &operator= (task &&)      = delete;
+
+    ~task ()
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready () const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<>
+    await_suspend (std::coroutine_handle<> caller) noexcept
+    {
+        m_handle.promise().continuation = caller;
+        return m_handle;
+    }
+
+    T await_resume ()
+    {
+        if (m_handle.promise().error)
+        {
+            std::rethrow_exception(m_handle.promise().error);
+        }
+        if constexpr (!std::is_void_v<T>)
+        {
+            return std::move(*m_handle.promise().value);
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle () const noexcept
+    {
+        return m_handle;
+    }
+
+  private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+task<T> detail::promise<T>::get_return_object () noexcept
+{
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> detail::promise<void>::get_return_object () noexcept
+{
+    return task<void>(
+        std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+/**
+ * @brief One atomic operation, a scheduling point of the thread that
+ * co_awaits it.
+ *
+ * @tparam T result of the operation
+ */
+template <typename T>
+class step
+{
+    using result_type =
+        std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+  public:
+    step (execution &ex, std::function<T()> body)
+        : m_ex(&ex), m_body(std::move(body))
+    {
+    }
+
+    bool await_ready () const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend (std::coroutine_handle<> self);
+
+    T await_resume ()
+    {
+        if constexpr (!std::is_void_v<T>)
+        {
+            return std::move(*m_result);
+        }
+    }
+
+  private:
+    execution *m_ex;
+    std::function<T()> m_body;
+    std::optional<result_type> m_result;
+};
+
+/**
+ * @brief One run of a model, driven by a schedule.
+ *
+ * The model body declares its locations, spawns its threads, calls run()
+ * and checks the final state with expect().
+ */
+class execution
+{
+  public:
+    execution (detail::schedule &schedule, std::uint32_t max_steps,
+               std::string *log)
+        : m_schedule(schedule), m_max_steps(max_steps), m_log(log)
+    {
+    }
+
+    execution (const execution &)            = delete;
+    execution &operator= (const execution &) = delete;
+
+    /**
+     * @brief Adds a thread, started by run().
+     *
+     * @param body callable returning task<>, kept alive until the
+     * execution ends so that a coroutine lambda may capture
+     */
+    template <typename F>
+    void spawn (F body)
+    {
+        m_bodies.emplace_back(std::move(body));
+    }
+
+    /**
+     * @brief Runs the threads to completion along the schedule.
+     */
+    void run ()
+    {
+        for (std::size_t i = 0; i < m_bodies.size(); ++i)
+        {
+            m_threads.emplace_back(slot(), m_bodies[i]);
+        }
+        // nikgub: code before the first operation touches nothing shared
+        for (std::size_t i = 0; i < m_threads.size() && !stopped(); ++i)
+        {
+            resume(i);
+        }
+        std::vector<std::size_t> runnable;
+        while (!stopped())
+        {
+            runnable.clear();
+            for (std::size_t i = 0; i < m_threads.size(); ++i)
+            {
+                if (!m_threads[i].done && !m_threads[i].parked)
+                {
+                    runnable.push_back(i);
+                }
+            }
+            if (runnable.empty())
+            {
+                for (std::size_t i = 0; i < m_threads.size(); ++i)
+                {
+                    if (m_threads[i].parked)
+                    {
+                        fail("thread " + std::to_string(i) +
+                             " parked forever on " +
+                             m_locations[m_threads[i].parked_on].name);
+                        break;
+                    }
+                }
+                break;
+            }
+            if (++m_steps > m_max_steps)
+            {
+                m_pruned = true;
+                break;
+            }
+            const std::size_t t =
+                runnable[m_schedule.choose(runnable.size())];
+            m_current                   = t;
+            std::function<void()> next = std::move(m_threads[t].pending);
+            next();
+            if (!stopped() && !m_threads[t].parked)
+            {
+                resume(t);
+            }
+        }
+    }
+
+    /**
+     * @brief Fails the execution unless ok holds.
+     */
+    bool expect (bool ok, const char *what)
+    {
+        if (!ok)
+        {
+            fail(std::string("expected ") + what);
+        }
+        return ok;
+    }
+
+    /**
+     * @brief Drops the execution, e.g. once a spin loop ran out of budget.
+     */
+    void prune () noexcept
+    {
+        m_pruned = true;
+    }
+
+    bool failed () const noexcept
+    {
+        return m_failure.has_value();
+    }
+
+    bool pruned () const noexcept
+    {
+        return m_pruned;
+    }
+
+    const std::string &failure () const noexcept
+    {
+        return *m_failure;
+    }
+
+    /**
+     * @brief Index of the thread running now, in spawn order.
+     */
+    std::size_t current () const noexcept
+    {
+        return m_current;
+    }
+
+  private:
+    template <typename>
+    friend class step;
+    template <typename>
+    friend class atomic;
+    template <typename>
+    friend class plain;
+
+    struct message
+    {
+        std::uint64_t value;
+        detail::view released;
+    };
+
+    struct location
+    {
+        std::string name;
+        std::size_t slot;
+        std::vector<message> history; // nikgub: in modification order
+    };
+
+    struct access
+    {
+        std::size_t slot;
+        std::uint32_t clock;
+    };
+
+    struct plain_location
+    {
+        std::string name;
+        std::optional<access> write;
+        std::vector<access> reads; // nikgub: since the last write
+    };
+
+    struct thread
+    {
+        thread (std::size_t s, std::function<task<>()> &make)
+            : slot(s), body(make()), resume_at(body.handle())
+        {
+        }
+
+        std::size_t slot;
+        task<> body;
+        std::coroutine_handle<> resume_at;
+        std::function<void()> pending;
+        detail::view current;
+        std::size_t parked_on = 0;
+        bool parked           = false;
+        bool done             = false;
+    };
+
+    /**
+     * @brief Index into every view, locations and threads get one each.
+     *
+     * A location entry is a position in its modification order, a thread
+     * entry counts the operations of that thread, which makes a view a
+     * vector clock for the race check of plain fields as well.
+     */
+    std::size_t slot () noexcept
+    {
+        return m_slots++;
+    }
+
+    bool stopped () const noexcept
+    {
+        return failed() || m_pruned;
+    }
+
+    void fail (std::string what)
+    {
+        if (!m_failure)
+        {
+            m_failure = std::move(what);
+            trace("  -> " + *m_failure);
+        }
+    }
+
+    void trace (const std::string &line)
+    {
+        if (m_log != nullptr)
+        {
+            *m_log += line;
+            *m_log += '\n';
+        }
+    }
+
+    void trace_op (const char *op, const location &l, std::uint64_t value)
+    {
+        if (m_log != nullptr)
+        {
+            trace("t" + std::to_string(m_current) + " " + op + " " + l.name +
+                  " " + std::to_string(value));
+        }
+    }
+
+    void resume (std::size_t t)
+    {
+        m_current = t;
+        thread &thr = m_threads[t];
+        thr.resume_at.resume();
+        if (thr.body.handle().done())
+        {
+            thr.done = true;
+            if (thr.body.handle().promise().error)
+            {
+                fail("thread " + std::to_string(t) + " threw");
+            }
+        }
+    }
+
+    void suspend (std::coroutine_handle<> at, std::function<void()> op)
+    {
+        m_threads[m_current].resume_at = at;
+        m_threads[m_current].pending   = std::move(op);
+    }
+
+    std::size_t add_location (const char *name, std::uint64_t value)
+    {
+        m_locations.push_back({name, slot(), {{value, {}}}});
+        return m_locations.size() - 1;
+    }
+
+    std::size_t add_plain (const char *name)
+    {
+        m_plains.push_back({name, std::nullopt, {}});
+        return m_plains.size() - 1;
+    }
+
+    detail::view &view () noexcept
+    {
+        return m_threads[m_current].current;
+    }
+
+    // nikgub: one tick per operation, the entry of the thread in its view
+    std::uint32_t tick ()
+    {
+        thread &thr = m_threads[m_current];
+        detail::raise(thr.current, thr.slot,
+                      detail::at(thr.current, thr.slot) + 1);
+        return detail::at(thr.current, thr.slot);
+    }
+
+    void enter (order o)
+    {
+        tick();
+        if (o == order::seq_cst)
+        {
+            detail::join(view(), m_sc);
+        }
+    }
+
+    void leave (order o)
+    {
+        if (o == order::seq_cst)
+        {
+            detail::join(m_sc, view());
+        }
+    }
+
+    void read_from (location &l, std::size_t index, order o)
+    {
+        detail::raise(view(), l.slot, static_cast<std::uint32_t>(index));
+        if (detail::acquires(o))
+        {
+            detail::join(view(), l.history[index].released);
+        }
+    }
+
+    void append (location &l, std::uint64_t value, order o,
+                 const detail::view *continued)
+    {
+        const auto position = static_cast<std::uint32_t>(l.history.size());
+        detail::raise(view(), l.slot, position);
+        detail::view released;
+        if (continued != nullptr)
+        {
+            released = *continued; // nikgub: release sequence of an RMW
+        }
+        if (detail::releases(o))
+        {
+            detail::join(released, view());
+        }
+        detail::raise(released, l.slot, position);
+        l.history.push_back({value, std::move(released)});
+    }
+
+    std::uint64_t load (std::size_t id, order o)
+    {
+        location &l = m_locations[id];
+        enter(o);
+        const std::size_t first = detail::at(view(), l.slot);
+        const std::size_t index =
+            first + m_schedule.choose(l.history.size() - first);
+        read_from(l, index, o);
+        leave(o);
+        trace_op("load", l, l.history[index].value);
+        return l.history[index].value;
+    }
+
+    void store (std::size_t id, std::uint64_t value, order o)
+    {
+        location &l = m_locations[id];
+        enter(o);
+        append(l, value, o, nullptr);
+        leave(o);
+        trace_op("store", l, value);
+    }
+
+    std::uint64_t rmw (std::size_t id,
+                       const std::function<std::uint64_t(std::uint64_t)> &f,
+                       order o)
+    {
+        location &l = m_locations[id];
+        enter(o);
+        const std::size_t last  = l.history.size() - 1;
+        const std::uint64_t old = l.history[last].value;
+        read_from(l, last, o);
+        const detail::view continued = l.history[last].released;
+        append(l, f(old), o, &continued);
+        leave(o);
+        trace_op("rmw", l, l.history.back().value);
+        return old;
+    }
+
+    bool compare_exchange (std::size_t id, std::uint64_t &expected,
+                           std::uint64_t desired, order success, order failure)
+    {
+        location &l = m_locations[id];
+        const bool sc =
+            success == order::seq_cst || failure == order::seq_cst;
+        enter(sc ? order::seq_cst : order::relaxed);
+        // nikgub: a strong CAS fails only on a value other than expected,
+        //         which it may read from anywhere past the view
+        const std::size_t last = l.history.size() - 1;
+        std::vector<std::size_t> failures;
+        for (std::size_t i = detail::at(view(), l.slot); i <= last; ++i)
+        {
+            if (l.history[i].value != expected)
+            {
+                failures.push_back(i);
+            }
+        }
+        const bool can_succeed = l.history[last].value == expected;
+        const std::size_t pick =
+            m_schedule.choose(failures.size() + (can_succeed ? 1 : 0));
+        bool succeeded = false;
+        if (can_succeed && pick == failures.size())
+        {
+            read_from(l, last, success);
+            const detail::view continued = l.history[last].released;
+            append(l, desired, success, &continued);
+            succeeded = true;
+        }
+        else
+        {
+            read_from(l, failures[pick], failure);
+            expected = l.history[failures[pick]].value;
+        }
+        leave(sc ? order::seq_cst : order::relaxed);
+        trace_op(succeeded ? "cas" : "cas failed", l,
+                 succeeded ? desired : expected);
+        return succeeded;
+    }
+
+    // nikgub: a futex, the comparison and the sleep are one step
+    void park (std::size_t id, std::uint64_t expected)
+    {
+        location &l = m_locations[id];
+        tick();
+        if (l.history.back().value == expected)
+        {
+            m_threads[m_current].parked    = true;
+            m_threads[m_current].parked_on = id;
+        }
+        trace_op(m_threads[m_current].parked ? "park" : "park refused", l,
+                 l.history.back().value);
+    }
+
+    void unpark_one (std::size_t id)
+    {
+        tick();
+        std::vector<std::size_t> sleepers;
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+        {
+            if (m_threads[i].parked && m_threads[i].parked_on == id)
+            {
+                sleepers.push_back(i);
+            }
+        }
+        trace_op("unpark", m_locations[id], sleepers.size());
+        if (!sleepers.empty())
+        {
+            thread &woken = m_threads[sleepers[m_schedule.choose(
+                sleepers.size())]];
+            woken.parked  = false;
+            woken.pending = [] {};
+        }
+    }
+
+    void plain_read (std::size_t id)
+    {
+        plain_location &p = m_plains[id];
+        const access mine = {m_threads[m_current].slot, tick()};
+        if (p.write && detail::at(view(), p.write->slot) < p.write->clock)
+        {
+            fail("data race reading " + p.name);
+        }
+        p.reads.push_back(mine);
+    }
+
+    void plain_write (std::size_t id)
+    {
+        plain_location &p = m_plains[id];
+        const access mine = {m_threads[m_current].slot, tick()};
+        bool ordered =
+            !p.write || detail::at(view(), p.write->slot) >= p.write->clock;
+        for (const access &read : p.reads)
+        {
+            ordered = ordered && detail::at(view(), read.slot) >= read.clock;
+        }
+        if (!ordered)
+        {
+            fail("data race writing " + p.name);
+        }
+        p.reads.clear();
+        p.write = mine;
+    }
+
+    detail::schedule &m_schedule;
+    std::uint32_t m_max_steps;
+    std::string *m_log;
+    std::deque<std::function<task<>()>> m_bodies;
+    std::deque<thread> m_threads;
+    std::deque<location> m_locations;
+    std::deque<plain_location> m_plains;
+    detail::view m_sc;
+    std::size_t m_slots   = 0;
+    std::size_t m_current = 0;
+    std::uint32_t m_steps = 0;
+    bool m_pruned         = false;
+    std::optional<std::string> m_failure;
+};
+
+template <typename T>
+void step<T>::await_suspend (std::coroutine_handle<> self)
+{
+    m_ex->suspend(self,
+                  [this]
+                  {
+                      if constexpr (std::is_void_v<T>)
+                      {
+                          m_body();
+                          m_result.emplace();
+                      }
+                      else
+                      {
+                          m_result.emplace(m_body());
+                      }
+                  });
+}
+
+/**
+ * @brief Model of std::atomic<T>, every operation is a step.
+ *
+ * @tparam T integral type, stored widened to 64 bits
+ */
+template <typename T>
+class atomic
+{
+  public:
+    atomic (execution &ex, const char *name, T value = T())
+        : m_ex(&ex),
+          m_id(ex.add_location(name, static_cast<std::uint64_t>(value)))
+    {
+    }
+
+    step<T> load (order o)
+    {
+        return {*m_ex, [this, o] { return T(m_ex->load(m_id, o)); }};
+    }
+
+    step<void> store (T value, order o)
+    {
+        return {*m_ex, [this, value, o]
+                { m_ex->store(m_id, static_cast<std::uint64_t>(value), o); }};
+    }
+
+    step<T> exchange (T value, order o)
+    {
+        return modify([value] (T) { return value; }, o);
+    }
+
+    step<T> fetch_add (T value, order o)
+    {
+        return modify([value] (T old) { return T(old + value); }, o);
+    }
+
+    step<T> fetch_or (T value, order o)
+    {
+        return modify([value] (T old) { return T(old | value); }, o);
+    }
+
+    step<T> fetch_and (T value, order o)
+    {
+        return modify([value] (T old) { return T(old & value); }, o);
+    }
+
+    /**
+     * @brief Strong compare-exchange, expected is updated on failure.
+     */
+    step<bool> compare_exchange (T &expected, T desired, order success,
+                                 order failure)
+    {
+        return {*m_ex, [this, &expected, desired, success, failure]
+                {
+                    auto wide = static_cast<std::uint64_t>(expected);
+                    const bool ok = m_ex->compare_exchange(
+                        m_id, wide, static_cast<std::uint64_t>(desired),
+                        success, failure);
+                    expected = T(wide);
+                    return ok;
+                }};
+    }
+
+    /**
+     * @brief detail::park, sleeps while the latest value is expected.
+     */
+    step<void> park (T expected)
+    {
+        return {*m_ex, [this, expected]
+                { m_ex->park(m_id, static_cast<std::uint64_t>(expected)); }};
+    }
+
+    /**
+     * @brief detail::unpark_one, wakes one thread parked here.
+     */
+    step<void> unpark_one ()
+    {
+        return {*m_ex, [this] { m_ex->unpark_one(m_id); }};
+    }
+
+    /**
+     * @brief Last value in modification order, for checks after run().
+     */
+    T final_value () const
+    {
+        return T(m_ex->m_locations[m_id].history.back().value);
+    }
+
+  private:
+    template <typename F>
+    step<T> modify (F f, order o)
+    {
+        return {*m_ex, [this, f, o]
+                {
+                    return T(m_ex->rmw(
+                        m_id,
+                        [&f] (std::uint64_t old)
+                        { return static_cast<std::uint64_t>(f(T(old))); },
+                        o));
+                }};
+    }
+
+    execution *m_ex;
+    std::size_t m_id;
+};
+
+/**
+ * @brief A non-atomic field, any two accesses of which, at least one a
+ * write, must be ordered by happens-before.
+ *
+ * Accesses are not steps, they are checked where they happen.
+ */
+template <typename T>
+class plain
+{
+  public:
+    plain (execution &ex, const char *name, T value = T())
+        : m_ex(&ex), m_id(ex.add_plain(name)), m_value(std::move(value))
+    {
+    }
+
+    T get () const
+    {
+        m_ex->plain_read(m_id);
+        return m_value;
+    }
+
+    void set (T value)
+    {
+        m_ex->plain_write(m_id);
+        m_value = std::move(value);
+    }
+
+    /**
+     * @brief The value without a race check, for checks after run().
+     */
+    const T &final_value () const noexcept
+    {
+        return m_value;
+    }
+
+  private:
+    execution *m_ex;
+    std::size_t m_id;
+    T m_value;
+};
+
+/**
+ * @brief What explore() found.
+ */
+struct outcome
+{
+    std::uint64_t executions = 0;
+    std::uint64_t pruned     = 0;
+    std::optional<std::string> failure;
+    std::string trace; // nikgub: steps of the failing execution
+};
+
+/**
+ * @brief Runs a model along every schedule, stops at the first failure.
+ *
+ * @param model callable invoked as model(execution&) once per execution
+ * @param max_steps steps after which an execution is pruned
+ * @returns executions explored, and the failure with its steps if any
+ */
+template <typename Model>
+outcome explore (Model &&model, std::uint32_t max_steps = 200)
+{
+    detail::schedule schedule;
+    outcome result;
+    do
+    {
+        execution ex(schedule, max_steps, nullptr);
+        model(ex);
+        ++result.executions;
+        if (ex.pruned() && !ex.failed())
+        {
+            ++result.pruned;
+        }
+        if (ex.failed())
+        {
+            result.failure = ex.failure();
+            // nikgub: deterministic, the replay takes the same steps
+            schedule.rewind();
+            execution replay(schedule, max_steps, &result.trace);
+            model(replay);
+            break;
+        }
+    } while (schedule.advance());
+    return result;
+}
+
+} // namespace ngg::model
@@ -0,0 +1,409 @@
+#include "check.hpp"
+#include "model.hpp"
+#include <mpsc_queue.hpp>
+#include <shm_mpsc_queue.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Litmus models of the handshakes in mpsc_queue.hpp and shm_mpsc_queue.hpp,
+ * restated with the memory orders the queues name in detail::mpsc_orders
+ * and detail::shm_orders, each explored exhaustively by model.hpp. Every
+ * model also runs weakened, an order relaxed or the tag dropped, and the
+ * checker has to catch that, otherwise passing proves nothing about the
+ * real orders.
+ */
+
+namespace
+{
+
+namespace model = ngg::model;
+using model::order;
+using mpsc = ngg::detail::mpsc_orders;
+using shm  = ngg::detail::shm_orders;
+
+// nikgub: node 0 is null in every model, like an index in shm_mpsc_queue
+
+/**
+ * @brief Nodes with an atomic next and a plain payload.
+ */
+struct nodes
+{
+    nodes (model::execution &ex, std::uint32_t count,
+           const std::vector<std::uint32_t> &links = {})
+    {
+        for (std::uint32_t i = 0; i <= count; ++i)
+        {
+            const std::string index = "[" + std::to_string(i) + "]";
+            next.emplace_back(ex, ("next" + index).c_str(),
+                              i < links.size() ? links[i] : 0);
+            data.emplace_back(ex, ("data" + index).c_str());
+        }
+    }
+
+    std::deque<model::atomic<std::uint32_t>> next;
+    std::deque<model::plain<int>> data;
+};
+
+struct push_orders
+{
+    order exchange = mpsc::link_exchange;
+    order publish  = mpsc::link_publish;
+    order consume  = mpsc::pull_next;
+};
+
+/**
+ * @brief link_chain() against try_pull().
+ *
+ * Producer 0 links a chain of two nodes, its inner link relaxed, producer
+ * 1 a single node. The consumer pulls until it saw all three payloads,
+ * each of which must be visible and in the order of its producer.
+ */
+model::outcome push_pull (push_orders o)
+{
+    return model::explore(
+        [o] (model::execution &ex)
+        {
+            nodes n(ex, 4);
+            model::atomic<std::uint32_t> head(ex, "head", 1);
+            std::vector<int> pulled;
+
+            auto link_chain = [&] (std::uint32_t first,
+                                   std::uint32_t last) -> model::task<>
+            {
+                const std::uint32_t prev =
+                    co_await head.exchange(last, o.exchange);
+                co_await n.next[prev].store(first, o.publish);
+            };
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    n.data[2].set(10);
+                    n.data[3].set(11);
+                    co_await n.next[2].store(3, order::relaxed);
+                    co_await link_chain(2, 3);
+                });
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    n.data[4].set(20);
+                    co_await link_chain(4, 4);
+                });
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    std::uint32_t tail = 1;
+                    for (int attempt = 0; attempt < 6 && pulled.size() < 3;
+                         ++attempt)
+                    {
+                        const std::uint32_t next =
+                            co_await n.next[tail].load(o.consume);
+                        if (next != 0)
+                        {
+                            pulled.push_back(n.data[next].get());
+                            tail = next;
+                        }
+                    }
+                    if (pulled.size() < 3)
+                    {
+                        ex.prune();
+                    }
+                });
+            ex.run();
+            if (ex.failed() || ex.pruned())
+            {
+                return;
+            }
+            const auto first  = std::find(pulled.begin(), pulled.end(), 10);
+            const auto second = std::find(pulled.begin(), pulled.end(), 11);
+            ex.expect(std::find(pulled.begin(), pulled.end(), 20) !=
+                          pulled.end(),
+                      "the single node pulled");
+            ex.expect(first < second && second != pulled.end(),
+                      "the chain pulled in order");
+            std::uint32_t linked = 0;
+            for (std::uint32_t i = n.next[1].final_value(); i != 0;
+                 i               = n.next[i].final_value())
+            {
+                ++linked;
+            }
+            ex.expect(linked == 3, "every node linked once");
+        });
+}
+
+struct park_orders
+{
+    order announce = mpsc::park_announce;
+    order recheck  = mpsc::park_recheck;
+    order exchange = mpsc::link_exchange;
+    order check    = mpsc::wake_check;
+};
+
+constexpr std::uint32_t consumer_parked = 1;
+constexpr std::uint32_t queue_closed    = 16;
+
+/**
+ * @brief The m_waiting handshake of link_chain() and close() against
+ * wait_impl().
+ *
+ * The consumer announces itself in m_waiting and re-checks m_head before
+ * it parks, the producer swaps m_head and then looks at m_waiting. One of
+ * them must see the other, or the consumer sleeps past the push. With
+ * closing, a third thread closes the queue the same way.
+ */
+model::outcome park_wake (park_orders o, bool closing)
+{
+    return model::explore(
+        [o, closing] (model::execution &ex)
+        {
+            nodes n(ex, 2);
+            model::atomic<std::uint32_t> head(ex, "head", 1);
+            model::atomic<std::uint32_t> waiting(ex, "waiting");
+
+            auto wake_consumer = [&] () -> model::task<>
+            {
+                const std::uint32_t state = co_await waiting.fetch_and(
+                    ~consumer_parked, mpsc::wake_claim);
+                if (state & consumer_parked)
+                {
+                    co_await waiting.unpark_one();
+                }
+            };
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    n.data[2].set(7);
+                    const std::uint32_t prev =
+                        co_await head.exchange(2, o.exchange);
+                    co_await n.next[prev].store(2, mpsc::link_publish);
+                    const std::uint32_t state =
+                        co_await waiting.load(o.check);
+                    if (state & consumer_parked)
+                    {
+                        co_await wake_consumer();
+                    }
+                });
+            if (closing)
+            {
+                ex.spawn(
+                    [&] () -> model::task<>
+                    {
+                        const std::uint32_t state =
+                            co_await waiting.fetch_or(queue_closed,
+                                                      o.announce);
+                        if (state & consumer_parked)
+                        {
+                            co_await waiting.unpark_one();
+                        }
+                    });
+            }
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    const std::uint32_t tail = 1;
+                    for (int round = 0; round < 3; ++round)
+                    {
+                        if (co_await n.next[tail].load(mpsc::pull_next) != 0)
+                        {
+                            ex.expect(n.data[2].get() == 7, "the payload");
+                            co_return;
+                        }
+                        const std::uint32_t state = co_await waiting.fetch_or(
+                            consumer_parked, o.announce);
+                        if ((state & queue_closed) ||
+                            co_await head.load(o.recheck) != tail)
+                        {
+                            co_await waiting.fetch_and(~consumer_parked,
+                                                       order::relaxed);
+                            if (state & queue_closed)
+                            {
+                                co_return;
+                            }
+                            continue;
+                        }
+                        co_await waiting.park(state | consumer_parked);
+                        co_await waiting.fetch_and(~consumer_parked,
+                                                   order::relaxed);
+                    }
+                    ex.prune(); // nikgub: only ever spun, nothing to see
+                });
+            ex.run();
+        });
+}
+
+struct stack_orders
+{
+    order pop   = shm::free_pop;
+    order push  = shm::free_push;
+    bool tagged = true; // nikgub: retag bumps the tag
+};
+
+constexpr std::uint64_t index_mask = UINT32_MAX;
+
+/**
+ * @brief The tagged Treiber free stack of shm_mpsc_queue.
+ *
+ * Starts with nodes 1, 2, 3 free. Thread 0 pops once, thread 1 pops twice
+ * and gives its first node back, the classic ABA schedule for thread 0.
+ * Every popped node is owned by one thread at a time, the payload it
+ * writes is ordered against the previous owner, and the stack holds what
+ * nobody owns.
+ */
+model::outcome free_stack (stack_orders o)
+{
+    return model::explore(
+        [o] (model::execution &ex)
+        {
+            nodes n(ex, 3, {0, 2, 3});
+            model::atomic<std::uint64_t> free(ex, "free", 1);
+            std::vector<std::uint32_t> owned;
+
+            auto retag = [o] (std::uint64_t top, std::uint64_t index)
+            {
+                return o.tagged ? ((top >> 32) + 1) << 32 | index : index;
+            };
+            auto pop_free = [&] () -> model::task<std::uint32_t>
+            {
+                std::uint64_t top = co_await free.load(o.pop);
+                while (true)
+                {
+                    const auto index = static_cast<std::uint32_t>(top &
+                                                                  index_mask);
+                    if (index == 0)
+                    {
+                        co_return 0;
+                    }
+                    const std::uint64_t next =
+                        co_await n.next[index].load(order::relaxed);
+                    if (co_await free.compare_exchange(
+                            top, retag(top, next), o.pop, o.pop))
+                    {
+                        co_return index;
+                    }
+                }
+            };
+            auto push_free = [&] (std::uint32_t index) -> model::task<>
+            {
+                std::uint64_t top = co_await free.load(order::relaxed);
+                do
+                {
+                    co_await n.next[index].store(
+                        static_cast<std::uint32_t>(top & index_mask),
+                        order::relaxed);
+                } while (!co_await free.compare_exchange(
+                    top, retag(top, index), o.push, order::relaxed));
+            };
+            auto take = [&] (std::uint32_t index, int owner)
+            {
+                ex.expect(n.data[index].get() == 0, "a node owned once");
+                n.data[index].set(owner);
+            };
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    const std::uint32_t a = co_await pop_free();
+                    if (a != 0)
+                    {
+                        take(a, 1);
+                        owned.push_back(a);
+                    }
+                });
+            ex.spawn(
+                [&] () -> model::task<>
+                {
+                    const std::uint32_t b = co_await pop_free();
+                    const std::uint32_t c = co_await pop_free();
+                    if (c != 0)
+                    {
+                        take(c, 2);
+                        owned.push_back(c);
+                    }
+                    if (b != 0)
+                    {
+                        take(b, 2);
+                        n.data[b].set(0);
+                        co_await push_free(b);
+                    }
+                });
+            ex.run();
+            if (ex.failed() || ex.pruned())
+            {
+                return;
+            }
+            std::vector<std::uint32_t> seen = owned;
+            for (auto i = static_cast<std::uint32_t>(free.final_value() &
+                                                     index_mask);
+                 i != 0 && seen.size() <= 3; i = n.next[i].final_value())
+            {
+                seen.push_back(i);
+            }
+            std::sort(seen.begin(), seen.end());
+            ex.expect(seen == std::vector<std::uint32_t>{1, 2, 3},
+                      "every node either owned or free, once");
+        });
+}
+
+/**
+ * @brief Checks that a model holds, prints the failing steps otherwise.
+ */
+void holds (const model::outcome &result)
+{
+    if (!NGG_EXPECT(!result.failure))
+    {
+        std::fprintf(stderr, "%s\n%s", result.failure->c_str(),
+                     result.trace.c_str());
+    }
+    NGG_EXPECT(result.executions > result.pruned);
+}
+
+/**
+ * @brief Checks that the checker catches a weakened model.
+ */
+void caught (const model::outcome &result, const char *what)
+{
+    if (!NGG_EXPECT(result.failure &&
+                    result.failure->find(what) != std::string::npos))
+    {
+        std::fprintf(stderr, "wanted %s, got %s after %llu executions\n",
+                     what, result.failure ? result.failure->c_str() : "none",
+                     static_cast<unsigned long long>(result.executions));
+    }
+}
+
+void push_pull_handshake ()
+{
+    holds(push_pull({}));
+    caught(push_pull({.publish = order::relaxed}), "data race");
+    caught(push_pull({.consume = order::relaxed}), "data race");
+}
+
+void park_wake_handshake ()
+{
+    holds(park_wake({}, false));
+    holds(park_wake({}, true));
+    caught(park_wake({.announce = order::acq_rel, .recheck = order::acquire,
+                      .exchange = order::acq_rel, .check = order::acquire},
+                     false),
+           "parked forever");
+}
+
+void free_stack_aba ()
+{
+    holds(free_stack({}));
+    caught(free_stack({.tagged = false}), "every node");
+    caught(free_stack({.push = order::relaxed}), "data race");
+}
+
+} // namespace
+
+int main ()
+{
+    ngg::test::run("model push/pull handshake", push_pull_handshake);
+    ngg::test::run("model park/wake handshake", park_wake_handshake);
+    ngg::test::run("model free stack aba", free_stack_aba);
+    return ngg::test::finish();
+}
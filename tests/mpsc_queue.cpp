@@ -0,0 +1,310 @@
+#include "check.hpp"
+#include "mpsc_queue.hpp"
+#include "policy.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+using ngg::test::tagged;
+
+// nikgub: shared by every rebound copy, the queue allocates nodes
+std::atomic<std::ptrdiff_t> live_allocations{0};
+
+/**
+ * @brief std::allocator that counts live allocations of all its copies.
+ */
+template <typename T>
+struct counting_allocator
+{
+    using value_type = T;
+
+    counting_allocator () = default;
+
+    template <typename U>
+    counting_allocator (const counting_allocator<U> &) noexcept
+    {
+    }
+
+    T *allocate (std::size_t n)
+    {
+        live_allocations.fetch_add(1, std::memory_order_relaxed);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate (T *p, std::size_t n) noexcept
+    {
+        live_allocations.fetch_sub(1, std::memory_order_relaxed);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator== (const counting_allocator<U> &) const noexcept
+    {
+        return true;
+    }
+};
+
+/**
+ * @brief A user policy written from scratch, without the reclaim member
+ * only mpmc_queue reads.
+ */
+struct bare_policy
+{
+    using node_pool = ngg::policy::heap_nodes;
+    using stats     = ngg::policy::no_stats;
+    using notifier  = ngg::policy::no_notifier;
+    using capacity  = ngg::policy::unbounded;
+    using tracing   = ngg::policy::no_tracing;
+
+    static constexpr std::size_t field_alignment   = 64;
+    static constexpr std::size_t prefetch_distance = 0;
+};
+
+static_assert(ngg::types::queue_policy<bare_policy>);
+
+void policy_without_reclaim ()
+{
+    ngg::mpsc_queue<int, std::allocator<int>, bare_policy> queue;
+    NGG_EXPECT(queue.push(1));
+    NGG_EXPECT(queue.pull() == 1);
+    NGG_EXPECT(!queue.pull());
+}
+
+void fifo_per_producer ()
+{
+    ngg::mpsc_queue<tagged> queue;
+    NGG_EXPECT(ngg::test::check_fifo(
+        queue, [] (auto &q, tagged t) { q.push(t); },
+        [] (auto &q, auto &sink) -> std::size_t
+        {
+            std::optional<tagged> v = q.pull();
+            if (!v)
+            {
+                return 0;
+            }
+            sink(*v);
+            return 1;
+        },
+        4, 50000));
+}
+
+void close_rejects_pushes ()
+{
+    ngg::mpsc_queue<int> queue;
+    NGG_EXPECT(!queue.is_closed());
+    NGG_EXPECT(queue.push(1));
+    NGG_EXPECT(queue.try_push(2));
+    NGG_EXPECT(queue.emplace(3));
+    queue.close();
+    queue.close();
+    NGG_EXPECT(queue.is_closed());
+    NGG_EXPECT(!queue.push(4));
+    NGG_EXPECT(!queue.try_push(5));
+    NGG_EXPECT(!queue.emplace(6));
+    NGG_EXPECT(!queue.push_bulk(std::vector<int>{7, 8}));
+    // nikgub: what was queued before stays, then waits report closed
+    NGG_EXPECT(queue.pull_wait() == 1);
+    NGG_EXPECT(queue.pull() == 2);
+    NGG_EXPECT(queue.pull_wait_for(1s) == 3);
+    NGG_EXPECT(!queue.pull_wait());
+    NGG_EXPECT(!queue.pull_wait_for(1s));
+}
+
+void close_wakes_parked_consumer ()
+{
+    ngg::mpsc_queue<int> queue;
+    std::jthread closer(
+        [&queue]
+        {
+            std::this_thread::sleep_for(20ms);
+            queue.close();
+        });
+    const auto start = std::chrono::steady_clock::now();
+    NGG_EXPECT(!queue.pull_wait());
+    NGG_EXPECT(std::chrono::steady_clock::now() - start < 5s);
+}
+
+void try_push_when_full ()
+{
+    ngg::mpsc_queue<int, std::allocator<int>, ngg::policy::capped<4>> queue;
+    for (int i = 0; i < 4; ++i)
+    {
+        NGG_EXPECT(queue.try_push(i));
+    }
+    NGG_EXPECT(!queue.try_push(4));
+    NGG_EXPECT(queue.pull() == 0);
+    NGG_EXPECT(queue.try_push(4));
+    int out = -1;
+    for (int i = 1; i <= 4; ++i)
+    {
+        NGG_EXPECT(queue.try_pull(out) && out == i);
+    }
+    NGG_EXPECT(!queue.try_pull(out) && out == 4);
+}
+
+void pull_wait_times_out ()
+{
+    ngg::mpsc_queue<int> queue;
+    auto start = std::chrono::steady_clock::now();
+    NGG_EXPECT(!queue.pull_wait_for(30ms));
+    NGG_EXPECT(std::chrono::steady_clock::now() - start >= 30ms);
+
+    start = std::chrono::steady_clock::now();
+    NGG_EXPECT(!queue.pull_wait_until(start - 1s));
+    NGG_EXPECT(std::chrono::steady_clock::now() - start < 1s);
+
+    // nikgub: a late push ends the wait long before the timeout
+    std::jthread producer(
+        [&queue]
+        {
+            std::this_thread::sleep_for(20ms);
+            queue.push(42);
+        });
+    start = std::chrono::steady_clock::now();
+    NGG_EXPECT(queue.pull_wait_for(10s) == 42);
+    NGG_EXPECT(std::chrono::steady_clock::now() - start < 5s);
+}
+
+void pull_wait_counts_one_empty_poll ()
+{
+    ngg::mpsc_queue<int, std::allocator<int>, ngg::policy::instrumented> queue;
+    NGG_EXPECT(!queue.pull_wait_for(20ms));
+    // nikgub: the spinning is not counted, every park is, and so are the
+    //         timed out pull and spurious wake-ups
+    NGG_EXPECT(queue.stats().empty_polls <= 8);
+}
+
+void pull_wait_stops ()
+{
+    ngg::mpsc_queue<int> queue;
+    std::stop_source source;
+    std::jthread stopper(
+        [&source]
+        {
+            std::this_thread::sleep_for(20ms);
+            source.request_stop();
+        });
+    NGG_EXPECT(!queue.pull_wait(source.get_token()));
+    stopper.join();
+    // nikgub: a stopped wait leaves the queue usable
+    queue.push(1);
+    NGG_EXPECT(queue.pull_wait(source.get_token()) == 1);
+}
+
+void bulk_drain ()
+{
+    ngg::mpsc_queue<std::string> queue;
+    std::vector<std::string> in;
+    for (int i = 0; i < 100; ++i)
+    {
+        in.push_back("value " + std::to_string(i));
+    }
+    NGG_EXPECT(queue.push_bulk(in));
+    NGG_EXPECT(queue.push_bulk(in.begin(), in.begin()));
+
+    std::vector<std::string> out;
+    NGG_EXPECT(queue.pull_bulk(std::back_inserter(out), 10) == 10);
+    std::size_t seen = 10;
+    NGG_EXPECT(queue.consume_all(
+                   [&] (std::string &&s) { NGG_EXPECT(s == in[seen++]); },
+                   30) == 30);
+    NGG_EXPECT(queue.drain(
+                   [&] (std::string &&s) { out.push_back(std::move(s)); }) ==
+               60);
+    NGG_EXPECT(out.size() == 70);
+    NGG_EXPECT(out.front() == in[0] && out[9] == in[9]);
+    NGG_EXPECT(out[10] == in[40] && out.back() == in[99]);
+    NGG_EXPECT(queue.drain() == 0);
+    NGG_EXPECT(!queue.pull());
+}
+
+void reserve_exhaustion ()
+{
+    using allocator = counting_allocator<int>;
+    {
+        ngg::mpsc_queue<int, allocator> queue;
+        const std::ptrdiff_t sentinel = live_allocations.load();
+        const std::size_t reserved    = queue.reserve(100, false);
+        NGG_EXPECT(reserved >= 100);
+        NGG_EXPECT(queue.reserved() == reserved);
+        NGG_EXPECT(queue.reserve(1000, false) == reserved);
+
+        // nikgub: the whole reserve is used before the allocator
+        const int total = static_cast<int>(reserved) + 10;
+        for (int i = 0; i < static_cast<int>(reserved); ++i)
+        {
+            queue.push(i);
+        }
+        NGG_EXPECT(live_allocations.load() == sentinel);
+        for (int i = static_cast<int>(reserved); i < total; ++i)
+        {
+            queue.push(i);
+        }
+        NGG_EXPECT(live_allocations.load() == sentinel + 10);
+        for (int i = 0; i < total; ++i)
+        {
+            NGG_EXPECT(queue.pull() == i);
+        }
+        NGG_EXPECT(!queue.pull());
+
+        // nikgub: popped nodes went back, a second round allocates nothing
+        const std::ptrdiff_t drained = live_allocations.load();
+        for (int i = 0; i < static_cast<int>(reserved) - 1; ++i)
+        {
+            queue.push(i);
+        }
+        NGG_EXPECT(live_allocations.load() == drained);
+        NGG_EXPECT(queue.drain() == reserved - 1);
+    }
+    NGG_EXPECT(live_allocations.load() == 0);
+}
+
+void reserve_constructor ()
+{
+    ngg::mpsc_queue<int> queue(64);
+    NGG_EXPECT(queue.reserved() >= 64);
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue.push(i);
+    }
+    int out       = -1;
+    bool in_order = true;
+    for (int i = 0; i < 1000; ++i)
+    {
+        in_order = in_order && queue.try_pull(out) && out == i;
+    }
+    NGG_EXPECT(in_order);
+}
+
+} // namespace
+
+int main ()
+{
+    ngg::test::run("fifo per producer", fifo_per_producer);
+    ngg::test::run("close rejects pushes", close_rejects_pushes);
+    ngg::test::run("close wakes a parked consumer",
+                   close_wakes_parked_consumer);
+    ngg::test::run("try_push when full", try_push_when_full);
+    ngg::test::run("pull_wait times out", pull_wait_times_out);
+    ngg::test::run("pull_wait counts one empty poll",
+                   pull_wait_counts_one_empty_poll);
+    ngg::test::run("pull_wait stops on request", pull_wait_stops);
+    ngg::test::run("bulk drain", bulk_drain);
+    ngg::test::run("reserve exhaustion", reserve_exhaustion);
+    ngg::test::run("reserve constructor", reserve_constructor);
+    ngg::test::run("policy without reclaim", policy_without_reclaim);
+    return ngg::test::finish();
+}
@@ -0,0 +1,236 @@
+#include "bounded_mpsc_queue.hpp"
+#include "check.hpp"
+#include "intrusive_mpsc_queue.hpp"
+#include "mpmc_queue.hpp"
+#include "numa_mpsc_queue.hpp"
+#include "priority_mpsc_queue.hpp"
+#include "segmented_mpsc_queue.hpp"
+#include "serial_executor.hpp"
+#include "sharded_mpsc_queue.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using ngg::test::tagged;
+
+constexpr std::uint32_t producers = 4;
+constexpr std::uint64_t per       = 20000;
+
+/**
+ * @brief Producers push through push() and emplace(), one consumer checks
+ * that every producer's elements come out once, in order.
+ */
+template <typename Queue>
+void fifo_per_producer ()
+{
+    Queue queue;
+    NGG_EXPECT(ngg::test::check_fifo(
+        queue,
+        [] (Queue &q, tagged t)
+        {
+            NGG_EXPECT(t.seq % 2 == 0 ? q.push(t)
+                                      : q.emplace(t.producer, t.seq));
+        },
+        [] (Queue &q, auto &sink) -> std::size_t
+        {
+            std::optional<tagged> v = q.pull();
+            if (!v)
+            {
+                return 0;
+            }
+            sink(*v);
+            return 1;
+        },
+        producers, per));
+}
+
+/**
+ * @brief close() turns pushes away and keeps what is queued.
+ */
+template <typename Queue>
+void close_rejects_pushes ()
+{
+    Queue queue;
+    NGG_EXPECT(!queue.is_closed());
+    NGG_EXPECT(queue.push(tagged{0, 0}));
+    NGG_EXPECT(queue.emplace(0u, 1u));
+    queue.close();
+    queue.close();
+    NGG_EXPECT(queue.is_closed());
+    NGG_EXPECT(!queue.push(tagged{0, 2}));
+    NGG_EXPECT(!queue.emplace(0u, 3u));
+    std::vector<tagged> out;
+    NGG_EXPECT(queue.consume_all([&out] (tagged &&t) { out.push_back(t); },
+                                 8) == 2);
+    NGG_EXPECT(out.size() == 2 && out[0].seq == 0 && out[1].seq == 1);
+    NGG_EXPECT(!queue.pull());
+}
+
+template <typename Queue>
+void family_member (const char *name)
+{
+    const std::string prefix = name;
+    ngg::test::run((prefix + " fifo per producer").c_str(),
+                   fifo_per_producer<Queue>);
+    ngg::test::run((prefix + " close").c_str(), close_rejects_pushes<Queue>);
+}
+
+/**
+ * @brief numa_mpsc_queue with a few more sub-queues than this box has.
+ */
+struct numa_queue : ngg::numa_mpsc_queue<tagged>
+{
+    numa_queue () : numa_mpsc_queue(3)
+    {
+    }
+};
+
+void bounded_capacity ()
+{
+    ngg::bounded_mpsc_queue<int> queue(8);
+    const std::size_t capacity = queue.capacity();
+    NGG_EXPECT(capacity >= 8);
+    for (std::size_t i = 0; i < capacity; ++i)
+    {
+        NGG_EXPECT(queue.try_push(static_cast<int>(i)));
+    }
+    NGG_EXPECT(!queue.try_push(-1));
+    NGG_EXPECT(queue.pull() == 0);
+    NGG_EXPECT(queue.try_emplace(-2));
+    queue.close();
+    NGG_EXPECT(queue.is_closed());
+    NGG_EXPECT(queue.pull() == 1);
+    NGG_EXPECT(queue.try_push(-3) == false);
+    std::size_t count = 0;
+    queue.consume_all([&count] (int &&) { ++count; });
+    NGG_EXPECT(count == capacity - 1);
+    NGG_EXPECT(!queue.pull());
+}
+
+void priority_order ()
+{
+    ngg::priority_mpsc_queue<int, 3> queue;
+    NGG_EXPECT(queue.push(2, 3));
+    NGG_EXPECT(queue.push(0, 1));
+    NGG_EXPECT(queue.emplace(1, 2));
+    NGG_EXPECT(queue.push(7, 4)); // nikgub: clamped to the lowest level
+    NGG_EXPECT(queue.pull() == 1);
+    NGG_EXPECT(queue.pull() == 2);
+    queue.close();
+    NGG_EXPECT(queue.is_closed());
+    NGG_EXPECT(!queue.push(0, 5));
+    NGG_EXPECT(queue.pull() == 3);
+    NGG_EXPECT(queue.pull() == 4);
+    NGG_EXPECT(!queue.pull());
+}
+
+struct item
+{
+    explicit item (int v) : value(v)
+    {
+    }
+
+    int value;
+    ngg::mpsc_hook hook;
+};
+
+void intrusive_fifo ()
+{
+    ngg::intrusive_mpsc_queue<item, &item::hook> queue;
+    std::deque<item> items;
+    for (int i = 0; i < 2 * static_cast<int>(per); ++i)
+    {
+        items.emplace_back(i);
+    }
+    std::jthread first(
+        [&]
+        {
+            for (std::uint64_t i = 0; i < per; ++i)
+            {
+                queue.push(items[i]);
+            }
+        });
+    std::jthread second(
+        [&]
+        {
+            for (std::uint64_t i = per; i < 2 * per; ++i)
+            {
+                queue.push(items[i]);
+            }
+        });
+    int last[2]         = {-1, static_cast<int>(per) - 1};
+    std::uint64_t count = 0;
+    bool ordered        = true;
+    while (count < 2 * per)
+    {
+        item *object = queue.pull();
+        if (object == nullptr)
+        {
+            continue;
+        }
+        int &prev = last[object->value >= static_cast<int>(per)];
+        ordered   = ordered && object->value == prev + 1;
+        prev      = object->value;
+        ++count;
+    }
+    NGG_EXPECT(ordered);
+    NGG_EXPECT(queue.pull() == nullptr);
+    queue.close();
+    NGG_EXPECT(queue.is_closed());
+    NGG_EXPECT(!queue.push(items.front()));
+    NGG_EXPECT(queue.pull() == nullptr);
+}
+
+void executor_runs_accepted_tasks ()
+{
+    ngg::serial_executor<> executor;
+    std::uint64_t ran = 0;
+    std::uint64_t accepted[2] = {0, 0};
+    std::jthread runner([&executor] { executor.run(); });
+    {
+        std::vector<std::jthread> threads;
+        for (int p = 0; p < 2; ++p)
+        {
+            threads.emplace_back(
+                [&, p]
+                {
+                    for (std::uint64_t i = 0; i < per; ++i)
+                    {
+                        accepted[p] += executor.submit([&ran] { ++ran; });
+                    }
+                });
+        }
+    }
+    executor.close();
+    NGG_EXPECT(!executor.submit([&ran] { ++ran; }));
+    runner.join();
+    NGG_EXPECT(ran == accepted[0] + accepted[1]);
+    NGG_EXPECT(ran == 2 * per);
+}
+
+} // namespace
+
+int main ()
+{
+    family_member<ngg::segmented_mpsc_queue<tagged>>("segmented");
+    family_member<ngg::sharded_mpsc_queue<tagged>>("sharded");
+    family_member<ngg::sharded_mpsc_queue<tagged, std::allocator<tagged>,
+                                          ngg::policy::defaults,
+                                          ngg::policy::approximate_fifo>>(
+        "sharded fifo");
+    family_member<numa_queue>("numa");
+    family_member<ngg::mpmc_queue<tagged>>("mpmc");
+    ngg::test::run("bounded capacity", bounded_capacity);
+    ngg::test::run("priority order", priority_order);
+    ngg::test::run("intrusive fifo", intrusive_fifo);
+    ngg::test::run("executor runs accepted tasks",
+                   executor_runs_accepted_tasks);
+    return ngg::test::finish();
+}
@@ -0,0 +1,184 @@
+#include "check.hpp"
+#include "shm_mpsc_queue.hpp"
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+
+using ngg::test::tagged;
+
+using queue_type = ngg::shm_mpsc_queue<tagged>;
+
+/**
+ * @brief A fresh shared memory object, unlinked again when done.
+ */
+struct scoped_name
+{
+    scoped_name ()
+        : name("/ngg-test-" + std::to_string(::getpid()) + "-" +
+               std::to_string(counter++))
+    {
+        ngg::shm_segment::unlink(name.c_str());
+    }
+
+    ~scoped_name ()
+    {
+        ngg::shm_segment::unlink(name.c_str());
+    }
+
+    static inline int counter = 0;
+    std::string name;
+};
+
+void rejects_bad_regions ()
+{
+    alignas(256) static std::byte small[64]{};
+    bool threw = false;
+    try
+    {
+        queue_type::create(small, sizeof(small));
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    NGG_EXPECT(threw);
+
+    scoped_name name;
+    ngg::shm_segment segment = ngg::shm_segment::create(
+        name.name.c_str(), queue_type::required_bytes(16));
+    threw = false;
+    try
+    {
+        // nikgub: zeroed, nobody created a queue there
+        queue_type::attach(segment.data(), segment.size());
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    NGG_EXPECT(threw);
+
+    threw = false;
+    try
+    {
+        queue_type::create(static_cast<std::byte *>(segment.data()) + 8,
+                           segment.size() - 8);
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    NGG_EXPECT(threw);
+
+    queue_type::create(segment.data(), segment.size());
+    threw = false;
+    try
+    {
+        ngg::shm_mpsc_queue<std::uint32_t>::attach(segment.data(),
+                                                   segment.size());
+    }
+    catch (const std::invalid_argument &)
+    {
+        threw = true;
+    }
+    NGG_EXPECT(threw);
+}
+
+void capacity_exhaustion ()
+{
+    scoped_name name;
+    ngg::shm_segment segment = ngg::shm_segment::create(
+        name.name.c_str(), queue_type::required_bytes(16));
+    queue_type queue = queue_type::create(segment.data(), segment.size());
+    const std::size_t capacity = queue.capacity();
+    NGG_EXPECT(capacity >= 16);
+    for (std::size_t i = 0; i < capacity; ++i)
+    {
+        NGG_EXPECT(queue.try_push(tagged{0, i}));
+    }
+    NGG_EXPECT(!queue.try_push(tagged{0, capacity}));
+    NGG_EXPECT(queue.pull().has_value());
+    NGG_EXPECT(queue.try_emplace(0u, capacity));
+    std::uint64_t expected = 1;
+    bool ordered           = true;
+    NGG_EXPECT(queue.consume_all(
+                   [&] (tagged &&t)
+                   { ordered = ordered && t.seq == expected++; }) == capacity);
+    NGG_EXPECT(ordered);
+    NGG_EXPECT(!queue.pull());
+}
+
+void fifo_per_producer ()
+{
+    scoped_name name;
+    ngg::shm_segment segment = ngg::shm_segment::create(
+        name.name.c_str(), queue_type::required_bytes(64));
+    queue_type queue = queue_type::create(segment.data(), segment.size());
+    NGG_EXPECT(ngg::test::check_fifo(
+        queue,
+        [] (queue_type &q, tagged t)
+        {
+            while (!q.try_push(t))
+            {
+                std::this_thread::yield(); // nikgub: full
+            }
+        },
+        [] (queue_type &q, auto &sink) { return q.consume_all(sink); }, 4,
+        20000));
+}
+
+/**
+ * @brief Two mappings of one object at different addresses, as two
+ * processes would see it.
+ *
+ * Single-threaded, sanitizers cannot relate atomics at two addresses.
+ */
+void shared_across_mappings ()
+{
+    scoped_name name;
+    ngg::shm_segment owner = ngg::shm_segment::create(
+        name.name.c_str(), queue_type::required_bytes(8));
+    ngg::shm_segment other = ngg::shm_segment::open(name.name.c_str());
+    NGG_EXPECT(owner.data() != other.data());
+    queue_type consumer = queue_type::create(owner.data(), owner.size());
+    queue_type producer = queue_type::attach(other.data(), other.size());
+    NGG_EXPECT(producer.capacity() == consumer.capacity());
+
+    for (std::uint64_t round = 0; round < 3; ++round)
+    {
+        for (std::uint64_t i = 0; i < producer.capacity(); ++i)
+        {
+            NGG_EXPECT(producer.try_push(tagged{1, round * 100 + i}));
+        }
+        NGG_EXPECT(!producer.try_push(tagged{1, 0}));
+        for (std::uint64_t i = 0; i < consumer.capacity(); ++i)
+        {
+            const std::optional<tagged> t = consumer.pull();
+            NGG_EXPECT(t && t->producer == 1 && t->seq == round * 100 + i);
+        }
+        NGG_EXPECT(!consumer.pull());
+    }
+
+    consumer.close();
+    NGG_EXPECT(producer.is_closed());
+    NGG_EXPECT(!producer.try_push(tagged{0, 0}));
+}
+
+} // namespace
+
+int main ()
+{
+    ngg::test::run("rejects bad regions", rejects_bad_regions);
+    ngg::test::run("capacity exhaustion", capacity_exhaustion);
+    ngg::test::run("fifo per producer", fifo_per_producer);
+    ngg::test::run("shared across mappings", shared_across_mappings);
+    return ngg::test::finish();
+}